@@ -0,0 +1,59 @@
+-- Generators of synthetic C headers for the benchmarks, returned as strings
+
+local gen = {}
+
+-- 'count' structs with a few fields each, every struct pointing to the previous one
+function gen.structs(count)
+        local out = {}
+        for i = 1, count do
+                out[#out+1] = string.format([[
+struct s%d {
+        int id;
+        unsigned flags : 4;
+        double values[4];
+        const char *name;
+        struct s%d *prev;
+};
+]], i, i > 1 and i - 1 or i)
+        end
+        return table.concat(out)
+end
+
+-- One struct with 'depth' levels of nested struct definitions. Each one is declared before the
+-- field using it, a definition inside the field declaration would be visited twice per level.
+function gen.nesting(depth)
+        local out = {}
+        for i = 1, depth do
+                out[#out+1] = string.rep("        ", i - 1) .. "struct n" .. i .. " {\n"
+                out[#out+1] = string.rep("        ", i) .. "int level" .. i .. ";\n"
+        end
+        for i = depth, 1, -1 do
+                local indent = string.rep("        ", i - 1)
+                out[#out+1] = indent .. "};\n"
+                if i > 1 then
+                        out[#out+1] = indent .. "struct n" .. i .. " field" .. i .. ";\n"
+                end
+        end
+        return table.concat(out)
+end
+
+-- An enum with 'count' constants
+function gen.enum(count)
+        local out = {"enum huge {\n"}
+        for i = 1, count do
+                out[#out+1] = string.format("        HUGE_%d = %d,\n", i, i * 3)
+        end
+        out[#out+1] = "};\n"
+        return table.concat(out)
+end
+
+-- 'count' variadic function prototypes, each taking a pointer to a freshly declared struct and returning int
+function gen.functions(count)
+        local out = {}
+        for i = 1, count do
+                out[#out+1] = string.format("struct f%d; int func%d(struct f%d *p, int n, ...);\n", i, i, i)
+        end
+        return table.concat(out)
+end
+
+return gen
@@ -0,0 +1,173 @@
+-- Benchmarks of luaclang over synthetic headers and the installed system headers.
+--
+-- Usage : lua bench/run.lua [output_file]
+-- Sizes are read from the environment : BENCH_STRUCTS (default 10000), BENCH_DEPTH (200),
+-- BENCH_ENUM (20000), BENCH_FUNCTIONS (5000), BENCH_INCLUDE (/usr/include, empty to skip).
+-- Each benchmark writes one JSON object per line to the output file (bench_output.txt by default)
+-- and a summary to stdout. Times are process CPU times from os.clock(), in milliseconds, except
+-- the parse_ms of system_headers which sums the wall-clock parse time of each file from
+-- parser:stats(), as parseAll() runs on several threads (their CPU time is parse_cpu_ms).
+
+package.path = "bench/?.lua;" .. package.path
+local luaclang = require "luaclang"
+local gen = require "gen"
+
+local output = assert(io.open(arg[1] or "bench_output.txt", "w"))
+
+local function size(name, default)
+        return tonumber(os.getenv(name)) or default
+end
+
+local function clock_ms(fn, ...)
+        local start = os.clock()
+        local a, b = fn(...)
+        return (os.clock() - start) * 1000, a, b
+end
+
+-- Peak resident set size of the process in kB, nil if /proc isn't available
+local function peak_rss()
+        local status = io.open("/proc/self/status")
+        if status == nil then
+                return nil
+        end
+        local text = status:read("a")
+        status:close()
+        return tonumber(text:match("VmHWM:%s*(%d+)"))
+end
+
+local function gc_ms()
+        return (clock_ms(collectgarbage, "collect"))
+end
+
+local function per_sec(count, ms)
+        return ms > 0 and math.floor(count / ms * 1000) or 0
+end
+
+local function report(name, fields)
+        fields.name = name
+        fields.peak_rss_kb = peak_rss()
+        local keys = {}
+        for key in pairs(fields) do
+                keys[#keys+1] = key
+        end
+        table.sort(keys)
+        local json, text = {}, {}
+        for _, key in ipairs(keys) do
+                local value = fields[key]
+                if math.type(value) == "float" then
+                        value = string.format("%.3f", value)
+                end
+                local encoded = type(value) == "string" and key ~= "name" and value or string.format("%q", value)
+                json[#json+1] = string.format("%q:%s", key, encoded)
+                text[#text+1] = key .. "=" .. tostring(value)
+        end
+        output:write("{", table.concat(json, ","), "}\n")
+        output:flush()
+        print(table.concat(text, " "))
+end
+
+-- Traverse the translation unit of 'parser' in the ways the binding offers
+local function traverse(parser)
+        local root = parser:getCursor()
+        local stats = {}
+        local nodes = 0
+        local ms = clock_ms(root.visitChildren, root, function()
+                nodes = nodes + 1
+                return "recurse"
+        end)
+        stats.nodes = nodes
+        stats.visit_ms = ms
+        stats.visit_nodes_per_sec = per_sec(nodes, ms)
+        stats.visit_gc_ms = gc_ms()
+
+        local callbacks = 0
+        ms = clock_ms(root.visitChildren, root, {reuseCursors = true}, function()
+                callbacks = callbacks + 1
+                return "recurse"
+        end)
+        stats.reuse_ms = ms
+        stats.reuse_callbacks_per_sec = per_sec(callbacks, ms)
+        stats.reuse_gc_ms = gc_ms()
+
+        local iterated = 0
+        ms = clock_ms(function()
+                for _ in root:descendants() do
+                        iterated = iterated + 1
+                end
+        end)
+        stats.descendants_ms = ms
+        stats.descendants_nodes_per_sec = per_sec(iterated, ms)
+        stats.descendants_gc_ms = gc_ms()
+
+        ms = clock_ms(root.extract, root)
+        stats.extract_ms = ms
+        stats.extract_gc_ms = gc_ms()
+        return stats
+end
+
+local function bench_source(name, source)
+        collectgarbage("collect")
+        local parse_ms, parser = clock_ms(luaclang.newParser, "bench/" .. name .. ".h", {source = source})
+        local stats = traverse(parser)
+        stats.bytes = #source
+        stats.parse_ms = parse_ms
+        parser:dispose()
+        report(name, stats)
+end
+
+-- Merge the declarations of 'source' into a declaration database, where every struct repeats the same field names
+local function bench_ingest(name, source)
+        collectgarbage("collect")
+        local parser = luaclang.newParser("bench/" .. name .. ".h", {source = source})
+        local db = luaclang.newDeclDB()
+        local ms, added = clock_ms(db.ingest, db, parser)
+        local records, ingested = db:count()
+        report(name, {bytes = #source, ingest_ms = ms, records = records, ingested = ingested, added = added,
+                      ingest_records_per_sec = per_sec(ingested, ms)})
+        db:dispose()
+        parser:dispose()
+end
+
+bench_source("structs", gen.structs(size("BENCH_STRUCTS", 10000)))
+bench_ingest("structs_ingest", gen.structs(size("BENCH_STRUCTS", 10000)))
+bench_source("nesting", gen.nesting(size("BENCH_DEPTH", 200)))
+bench_source("enum", gen.enum(size("BENCH_ENUM", 20000)))
+bench_source("functions", gen.functions(size("BENCH_FUNCTIONS", 5000)))
+
+local include_dir = os.getenv("BENCH_INCLUDE") or "/usr/include"
+if include_dir ~= "" then
+        local files = {}
+        local quoted = "'" .. include_dir:gsub("'", "'\\''") .. "'"
+        local list = io.popen("ls " .. quoted .. "/*.h 2>/dev/null")
+        for file in list:lines() do
+                files[#files+1] = file
+        end
+        list:close()
+        if #files > 0 then
+                collectgarbage("collect")
+                local parse_cpu_ms, parsers = clock_ms(luaclang.parseAll, files, {keepGoing = true, incomplete = true})
+                local totals = {files = #files, failed = 0, parse_ms = 0, parse_cpu_ms = parse_cpu_ms, nodes = 0,
+                                visit_ms = 0, reuse_ms = 0, descendants_ms = 0, extract_ms = 0, gc_ms = 0}
+                for i, parser in ipairs(parsers) do
+                        if parser then
+                                totals.parse_ms = totals.parse_ms + parser:stats().parseTime * 1000
+                                local stats = traverse(parser)
+                                for _, key in ipairs({"nodes", "visit_ms", "reuse_ms", "descendants_ms", "extract_ms"}) do
+                                        totals[key] = totals[key] + stats[key]
+                                end
+                                totals.gc_ms = totals.gc_ms + stats.visit_gc_ms + stats.reuse_gc_ms +
+                                               stats.descendants_gc_ms + stats.extract_gc_ms
+                                parser:dispose()
+                        else
+                                totals.failed = totals.failed + 1
+                        end
+                        parsers[i] = nil
+                end
+                totals.visit_nodes_per_sec = per_sec(totals.nodes, totals.visit_ms)
+                totals.reuse_callbacks_per_sec = per_sec(totals.nodes, totals.reuse_ms)
+                totals.descendants_nodes_per_sec = per_sec(totals.nodes, totals.descendants_ms)
+                report("system_headers", totals)
+        end
+end
+
+output:close()
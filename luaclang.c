@@ -2,14 +2,38 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
 
+#define INDEX_METATABLE  "Clang.Index"
 #define PARSER_METATABLE  "Clang.Parser"
 #define CURSOR_METATABLE "Clang.Cursor"
 #define TYPE_METATABLE   "Clang.Type"
+#define CURSOR_ITERATOR_METATABLE "Clang.CursorIterator"
+#define PARSE_HANDLE_METATABLE "Clang.ParseHandle"
+#define CURSOR_CACHE "Clang.CursorCache"
+#define TYPE_CACHE "Clang.TypeCache"
+#define PARSER_REGISTRY "Clang.Parsers"
+#define DIAGNOSTIC_METATABLE "Clang.Diagnostic"
+#define DIAGNOSTIC_PATHS "Clang.DiagnosticPaths"
+#define DECL_DB_METATABLE "Clang.DeclDB"
+#define PARSE_JOBS_METATABLE "Clang.ParseJobs"
+#define EXTRACT_RESOURCES_METATABLE "Clang.ExtractResources"
+#define PCH_POOL_METATABLE "Clang.PCHPool"
+#define PCH_POOL "Clang.SharedPCH"
+#define CURSOR_KIND_IDS "Clang.CursorKindIds"
 
 #define new_object(L, ptr, mt) {\
 	ptr = (typeof(ptr)) lua_newuserdata(L, sizeof(*ptr)); \
@@ -19,473 +43,5912 @@
 #define to_object(L, ptr, mt, n) {\
         ptr = (typeof(ptr)) luaL_checkudata(L, n, mt); }
 
+typedef struct clang_index {
+        CXIndex idx;
+        int num_parsers;        /* live parsers created from this index */
+        bool dispose_pending;   /* dispose once the last parser is gone */
+        bool exclude_pch;       /* excludeDeclarationsFromPCH, its parsers don't use the shared PCH */
+} clang_index;
+
+/* Canonical types interned by parser:internType(), the id of a type is its position in 'types' plus one */
+typedef struct type_table {
+        CXType *types;
+        unsigned count;
+        unsigned capacity;
+        unsigned committed;     /* ids up to this one are described, the others were added by a failed call */
+        unsigned *slots;        /* open addressing on type_hash(), ids or 0 if free */
+        unsigned num_slots;     /* power of two, at least twice 'count' */
+} type_table;
+
+typedef struct decl_entry {
+        CXCursor cursor;
+        size_t name;            /* offsets of the spelling and USR in 'strings' */
+        size_t usr;
+        unsigned next_name;     /* id of the next declaration with the same name, 0 if none */
+        bool merged;            /* same USR as an earlier declaration, which represents both */
+} decl_entry;
+
+/* Declarations indexed by parser:buildIndex(), the id of a declaration is its position in 'decls' plus one */
+typedef struct decl_index {
+        decl_entry *decls;
+        unsigned count;
+        char *strings;
+        unsigned *usr_slots;    /* open addressing on the USR, ids or 0 if free */
+        unsigned *name_slots;   /* first declaration of each name, the others are chained by next_name */
+        unsigned num_slots;     /* power of two, at least twice 'count' */
+} decl_index;
+
+/* Counters reported by parser:stats() */
+typedef struct parser_counters {
+        double parse_time;              /* wall-clock seconds of the last parse or reparse */
+        unsigned num_reparses;
+        unsigned long long cursors_visited;     /* by visitChildren, the cursor iterators and extract */
+        unsigned long long callbacks;           /* calls of Lua visitor functions */
+        unsigned long long objects;             /* cursor and type objects allocated */
+        bool used_pch;                  /* the shared PCH of luaclang.usePCH() was included */
+} parser_counters;
+
 typedef struct clang_parser {
         CXIndex idx;
         CXTranslationUnit tu;
+        clang_index *index;     /* shared index, NULL if idx is owned by the parser */
+        struct CXUnsavedFile *unsaved;  /* unsaved files of the last (re)parse */
+        unsigned num_unsaved;
+        type_table *types;      /* NULL until a type is interned */
+        decl_index *decls;      /* NULL until the declarations are indexed */
+        parser_counters stats;
 } clang_parser;
 
+/* Wall-clock time in seconds, for timing parses */
+static double now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Read an optional boolean field from the options table at 'arg' */
+static bool opt_boolean(lua_State *L, int arg, const char *field, bool def)
+{
+        if (lua_isnoneornil(L, arg))
+                return def;
+        lua_getfield(L, arg, field);
+        bool value = lua_isnil(L, -1) ? def : lua_toboolean(L, -1);
+        lua_pop(L, 1);
+        return value;
+}
+
+/* Release the shared index once it was disposed and no parser is using it anymore */
+static void index_release(clang_index *index)
+{
+        if (index->idx != NULL && index->dispose_pending && index->num_parsers == 0) {
+                clang_disposeIndex(index->idx);
+                index->idx = NULL;
+        }
+}
+
+/*
+        Cursors and types are cached per translation unit in weak tables, so that equal
+        entities are represented by the same Lua object. The registry tables CURSOR_CACHE and
+        TYPE_CACHE map the translation unit to its cache, which maps the hash of an object to
+        the object. Colliding hashes are probed at steps of CACHE_PROBE. As the collector clears
+        entries anywhere in a chain, a lookup doesn't stop at the first hole but probes as deep
+        as the longest chain ever built, which the cache keeps in its field "depth".
+*/
+#define CACHE_PROBE ((lua_Integer) 1 << 32)
+
+static parser_counters *find_stats(lua_State *L, CXTranslationUnit tu);
+static const char *map_file(const char *path, size_t *size);
+static void unmap_file(const char *data, size_t size);
+
+/*
+        Push the cache of 'tu' from the registry table 'name', creating it if needed. A new cache keeps
+        the counters of the parser owning 'tu' in its field "stats", see cache_stats(). If 'tu' has no
+        parser and 'parser_only' is set, nothing is pushed and false is returned.
+*/
+static bool push_cache(lua_State *L, const char *name, CXTranslationUnit tu, bool parser_only)
+{
+        lua_getfield(L, LUA_REGISTRYINDEX, name);
+        if (lua_rawgetp(L, -1, tu) == LUA_TNIL) {
+                lua_pop(L, 1);
+                parser_counters *stats = find_stats(L, tu);
+                if (stats == NULL && parser_only) {
+                        lua_pop(L, 1);
+                        return false;
+                }
+                lua_newtable(L);
+                lua_newtable(L);
+                lua_pushliteral(L, "v");
+                lua_setfield(L, -2, "__mode");
+                lua_setmetatable(L, -2);
+                if (stats != NULL) {
+                        lua_pushlightuserdata(L, stats);
+                        lua_setfield(L, -2, "stats");
+                }
+                lua_pushvalue(L, -1);
+                lua_rawsetp(L, -3, tu);
+        }
+        lua_remove(L, -2);
+        return true;
+}
+
+/* Return the counters kept by the cache on top of the stack, NULL if its translation unit has no parser */
+static parser_counters *cache_stats(lua_State *L)
+{
+        lua_getfield(L, -1, "stats");
+        parser_counters *stats = (parser_counters *) lua_touserdata(L, -1);
+        lua_pop(L, 1);
+        return stats;
+}
+
+/*
+        Look up the cache on top of the stack for the object of hash 'key' which 'equal' holds for.
+        If found, the cache is replaced by the object. Otherwise the cache stays on top and
+        'free_key' receives the key the new object is to be stored at.
+*/
+static bool cache_find(lua_State *L, lua_Integer key, bool (*equal)(const void *object, const void *entity),
+                       const void *entity, lua_Integer *free_key)
+{
+        lua_getfield(L, -1, "depth");
+        lua_Integer depth = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        bool have_free = false;
+        for (lua_Integer i = 0; i < depth; i++, key += CACHE_PROBE) {
+                if (lua_rawgeti(L, -1, key) == LUA_TNIL) {
+                        if (!have_free)
+                                *free_key = key;
+                        have_free = true;
+                } else if (equal(lua_touserdata(L, -1), entity)) {
+                        lua_remove(L, -2);
+                        return true;
+                }
+                lua_pop(L, 1);
+        }
+        if (!have_free) {
+                *free_key = key;
+                lua_pushinteger(L, depth + 1);
+                lua_setfield(L, -2, "depth");
+        }
+        return false;
+}
+
+static bool equal_cursors(const void *object, const void *entity)
+{
+        return clang_equalCursors(*(const CXCursor *) object, *(const CXCursor *) entity);
+}
+
+static bool equal_types(const void *object, const void *entity)
+{
+        return clang_equalTypes(*(const CXType *) object, *(const CXType *) entity);
+}
+
+/* Drop the cached cursors and types of 'tu', once it is disposed or reparsed */
+static void drop_caches(lua_State *L, CXTranslationUnit tu)
+{
+        const char *names[] = {CURSOR_CACHE, TYPE_CACHE};
+        for (int i = 0; i < 2; i++) {
+                lua_getfield(L, LUA_REGISTRYINDEX, names[i]);
+                lua_pushnil(L);
+                lua_rawsetp(L, -2, tu);
+                lua_pop(L, 1);
+        }
+}
+
+/*
+        The registry table PARSER_REGISTRY maps a translation unit to its parser object, with
+        weak values, so that cursors and types can account for their work in parser:stats().
+*/
+static void register_parser(lua_State *L, int arg, CXTranslationUnit tu)
+{
+        arg = lua_absindex(L, arg);
+        lua_getfield(L, LUA_REGISTRYINDEX, PARSER_REGISTRY);
+        lua_pushvalue(L, arg);
+        lua_rawsetp(L, -2, tu);
+        lua_pop(L, 1);
+}
+
+static void unregister_parser(lua_State *L, CXTranslationUnit tu)
+{
+        lua_getfield(L, LUA_REGISTRYINDEX, PARSER_REGISTRY);
+        lua_pushnil(L);
+        lua_rawsetp(L, -2, tu);
+        lua_pop(L, 1);
+}
+
+/* Return the counters of the parser owning 'tu', NULL if there is none */
+static parser_counters *find_stats(lua_State *L, CXTranslationUnit tu)
+{
+        if (tu == NULL)
+                return NULL;
+        lua_getfield(L, LUA_REGISTRYINDEX, PARSER_REGISTRY);
+        lua_rawgetp(L, -1, tu);
+        clang_parser *parser = (clang_parser *) lua_touserdata(L, -1);
+        lua_pop(L, 2);
+        return parser != NULL ? &parser->stats : NULL;
+}
+
+static unsigned type_hash(CXType type)
+{
+        return (unsigned) (((uintptr_t) type.data[0] >> 4) ^ (uintptr_t) type.data[1] ^ type.kind);
+}
+
+/* Push a CXString and dispose it */
+static void push_cxstring(lua_State *L, CXString str)
+{
+        lua_pushstring(L, clang_getCString(str));
+        clang_disposeString(str);
+}
+
+static void free_type_table(clang_parser *parser)
+{
+        if (parser->types == NULL)
+                return;
+        free(parser->types->types);
+        free(parser->types->slots);
+        free(parser->types);
+        parser->types = NULL;
+}
+
+static void free_decl_index(clang_parser *parser)
+{
+        if (parser->decls == NULL)
+                return;
+        free(parser->decls->decls);
+        free(parser->decls->strings);
+        free(parser->decls->usr_slots);
+        free(parser->decls->name_slots);
+        free(parser->decls);
+        parser->decls = NULL;
+}
+
+/* Return the id of 'type' in 'table', 0 if it isn't interned */
+static unsigned type_table_find(const type_table *table, CXType type)
+{
+        if (table->num_slots == 0)
+                return 0;
+        unsigned mask = table->num_slots - 1;
+        for (unsigned i = type_hash(type) & mask; table->slots[i] != 0; i = (i + 1) & mask) {
+                if (clang_equalTypes(table->types[table->slots[i] - 1], type))
+                        return table->slots[i];
+        }
+        return 0;
+}
+
+/* Remove the types whose ids are above 'count' */
+static void type_table_truncate(type_table *table, unsigned count)
+{
+        unsigned mask = table->num_slots - 1;
+        memset(table->slots, 0, table->num_slots * sizeof(unsigned));
+        for (unsigned id = 1; id <= count; id++) {
+                unsigned i = type_hash(table->types[id - 1]) & mask;
+                while (table->slots[i] != 0)
+                        i = (i + 1) & mask;
+                table->slots[i] = id;
+        }
+        table->count = count;
+}
+
+/* Add 'type', which isn't interned yet, and return its id, 0 if out of memory */
+static unsigned type_table_add(type_table *table, CXType type)
+{
+        if (table->count == table->capacity) {
+                unsigned capacity = table->capacity ? table->capacity * 2 : 64;
+                CXType *types = (CXType *) realloc(table->types, capacity * sizeof(CXType));
+                if (types == NULL)
+                        return 0;
+                table->types = types;
+                table->capacity = capacity;
+        }
+        if (2 * (table->count + 1) > table->num_slots) {
+                unsigned num_slots = table->num_slots ? table->num_slots * 2 : 128;
+                unsigned *slots = (unsigned *) calloc(num_slots, sizeof(unsigned));
+                if (slots == NULL)
+                        return 0;
+                for (unsigned id = 1; id <= table->count; id++) {
+                        unsigned i = type_hash(table->types[id - 1]) & (num_slots - 1);
+                        while (slots[i] != 0)
+                                i = (i + 1) & (num_slots - 1);
+                        slots[i] = id;
+                }
+                free(table->slots);
+                table->slots = slots;
+                table->num_slots = num_slots;
+        }
+        table->types[table->count++] = type;
+        unsigned i = type_hash(type) & (table->num_slots - 1);
+        while (table->slots[i] != 0)
+                i = (i + 1) & (table->num_slots - 1);
+        table->slots[i] = table->count;
+        return table->count;
+}
+
+/* Push the object representing 'cursor', a cached one if it exists */
+static void push_cursor(lua_State *L, CXCursor cursor)
+{
+        CXCursor *cur;
+        CXTranslationUnit tu = clang_Cursor_getTranslationUnit(cursor);
+        if (tu == NULL) {
+                new_object(L, cur, CURSOR_METATABLE);
+                *cur = cursor;
+                return;
+        }
+        push_cache(L, CURSOR_CACHE, tu, false);
+        lua_Integer key;
+        if (cache_find(L, clang_hashCursor(cursor), equal_cursors, &cursor, &key))
+                return;
+        parser_counters *stats = cache_stats(L);
+        if (stats != NULL)
+                stats->objects++;
+        new_object(L, cur, CURSOR_METATABLE);
+        *cur = cursor;
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, key);
+        lua_remove(L, -2);
+}
+
+/* Push the object representing 'type', a cached one if it exists */
+static void push_type(lua_State *L, CXType type)
+{
+        CXType *cur_type;
+        /*
+                libclang has no public accessor for the translation unit of a type. This relies on
+                its internal layout (clang's cxtype::GetTU() reads data[1]), so the pointer is only
+                trusted if it is the translation unit of a live parser, otherwise the type isn't cached.
+        */
+        CXTranslationUnit tu = (CXTranslationUnit) type.data[1];
+        if (tu == NULL || !push_cache(L, TYPE_CACHE, tu, true)) {
+                new_object(L, cur_type, TYPE_METATABLE);
+                *cur_type = type;
+                return;
+        }
+        lua_Integer key;
+        if (cache_find(L, type_hash(type), equal_types, &type, &key))
+                return;
+        cache_stats(L)->objects++;
+        new_object(L, cur_type, TYPE_METATABLE);
+        *cur_type = type;
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, key);
+        lua_remove(L, -2);
+}
+
+/* Options accepted by the functions creating a translation unit */
+typedef struct parse_options {
+        const char **args;      /* compiler arguments, strings owned by the options table */
+        int num_args;
+        struct CXUnsavedFile *unsaved;  /* in-memory file contents, referencing Lua strings */
+        unsigned num_unsaved;
+        unsigned flags;         /* CXTranslationUnit_Flags */
+        const struct pch_pool *pch;     /* shared PCH built with 'args', NULL if there is none, see parse_args() */
+        const char **pch_args;  /* 'args' followed by the options including the PCH */
+} parse_options;
+
+static const struct {
+        const char *name;
+        unsigned flag;
+} parse_flags[] = {
+        {"skipFunctionBodies", CXTranslationUnit_SkipFunctionBodies},
+        {"incomplete", CXTranslationUnit_Incomplete},
+        {"keepGoing", CXTranslationUnit_KeepGoing},
+        {"singleFileParse", CXTranslationUnit_SingleFileParse},
+        {"limitSkipFunctionBodiesToPreamble", CXTranslationUnit_LimitSkipFunctionBodiesToPreamble},
+        {"precompiledPreamble", CXTranslationUnit_PrecompiledPreamble},
+        {"detailedPreprocessingRecord", CXTranslationUnit_DetailedPreprocessingRecord},
+        {NULL, 0}
+};
+
+/* --Precompiled headers-- */
+
+/* Header the shared precompiled header depends on, as it was when the PCH was built */
+typedef struct pch_dependency {
+        char *file_name;
+        struct timespec mtime;
+        off_t size;
+} pch_dependency;
+
+/* Precompiled header set by luaclang.usePCH(), used by the parsers created with the same compiler arguments */
+typedef struct pch_pool {
+        char *pch_file;
+        char *source;           /* generated header including the common headers */
+        char **includes;        /* names of the common headers, in the order they are included */
+        int num_includes;
+        char **args;
+        int num_args;
+        pch_dependency *deps;   /* NULL until the PCH was built */
+        unsigned num_deps;
+} pch_pool;
+
+static void pch_free_deps(pch_pool *pool)
+{
+        for (unsigned i = 0; i < pool->num_deps; i++)
+                free(pool->deps[i].file_name);
+        free(pool->deps);
+        pool->deps = NULL;
+        pool->num_deps = 0;
+}
+
+/* __gc of the pool */
+static int pch_gc(lua_State *L)
+{
+        pch_pool *pool = (pch_pool *) lua_touserdata(L, 1);
+        pch_free_deps(pool);
+        for (int i = 0; i < pool->num_args; i++)
+                free(pool->args[i]);
+        free(pool->args);
+        for (int i = 0; i < pool->num_includes; i++)
+                free(pool->includes[i]);
+        free(pool->includes);
+        free(pool->source);
+        free(pool->pch_file);
+        return 0;
+}
+
+static bool pch_stat(const char *file_name, struct timespec *mtime, off_t *size)
+{
+        struct stat st;
+        if (stat(file_name, &st) != 0)
+                return false;
+        *mtime = st.st_mtim;
+        *size = st.st_size;
+        return true;
+}
+
+static void pch_add_dependency(CXFile file, CXSourceLocation *stack, unsigned stack_len, CXClientData data)
+{
+        pch_pool *pool = (pch_pool *) data;
+        if (stack_len == 0 || pool->deps == NULL)
+                return;         /* the generated header itself, or out of memory */
+        pch_dependency *deps = (pch_dependency *) realloc(pool->deps, (pool->num_deps + 1) * sizeof(*deps));
+        if (deps == NULL) {
+                pch_free_deps(pool);
+                return;
+        }
+        pool->deps = deps;
+        CXString name = clang_getFileName(file);
+        pch_dependency *dep = &deps[pool->num_deps];
+        dep->file_name = strdup(clang_getCString(name));
+        clang_disposeString(name);
+        if (dep->file_name == NULL || !pch_stat(dep->file_name, &dep->mtime, &dep->size)) {
+                free(dep->file_name);
+                pch_free_deps(pool);
+                return;
+        }
+        pool->num_deps++;
+}
+
+static bool has_errors(CXTranslationUnit tu)
+{
+        unsigned num_diags = clang_getNumDiagnostics(tu);
+        for (unsigned i = 0; i < num_diags; i++) {
+                CXDiagnostic diag = clang_getDiagnostic(tu, i);
+                enum CXDiagnosticSeverity severity = clang_getDiagnosticSeverity(diag);
+                clang_disposeDiagnostic(diag);
+                if (severity >= CXDiagnostic_Error)
+                        return true;
+        }
+        return false;
+}
+
+/* Parse the generated header and save it as 'pch_file', returns an error message or NULL */
+static const char *pch_build(pch_pool *pool)
+{
+        pch_free_deps(pool);
+        size_t len = strlen(pool->pch_file);
+        char *header = (char *) malloc(len + 3);
+        CXIndex idx = clang_createIndex(0, 0);
+        if (header == NULL || idx == NULL) {
+                free(header);
+                if (idx != NULL)
+                        clang_disposeIndex(idx);
+                return "not enough memory";
+        }
+        memcpy(header, pool->pch_file, len);
+        memcpy(header + len, ".h", 3);
+        struct CXUnsavedFile unsaved = {header, pool->source, strlen(pool->source)};
+        CXTranslationUnit tu = clang_parseTranslationUnit(idx, header, (const char *const *) pool->args,
+                                                          pool->num_args, &unsaved, 1,
+                                                          CXTranslationUnit_Incomplete |
+                                                          CXTranslationUnit_ForSerialization |
+                                                          CXTranslationUnit_DetailedPreprocessingRecord);
+        const char *err = NULL;
+        if (tu == NULL) {
+                err = "precompiled header wasn't created";
+        } else if (has_errors(tu)) {
+                err = "precompiled header has errors";
+        } else if (clang_saveTranslationUnit(tu, pool->pch_file, clang_defaultSaveOptions(tu)) != 0) {
+                err = "precompiled header couldn't be saved";
+        } else {
+                pool->deps = (pch_dependency *) malloc(sizeof(pch_dependency));
+                clang_getInclusions(tu, pch_add_dependency, pool);
+                if (pool->deps == NULL)
+                        err = "headers of the precompiled header couldn't be read";
+        }
+        if (tu != NULL)
+                clang_disposeTranslationUnit(tu);
+        clang_disposeIndex(idx);
+        free(header);
+        if (err != NULL)
+                pch_free_deps(pool);
+        return err;
+}
+
+/* Check whether the PCH exists and none of the headers it depends on changed since it was built */
+static bool pch_is_fresh(const pch_pool *pool)
+{
+        struct timespec mtime;
+        off_t size;
+        if (pool->deps == NULL || access(pool->pch_file, R_OK) != 0)
+                return false;
+        for (unsigned i = 0; i < pool->num_deps; i++) {
+                const pch_dependency *dep = &pool->deps[i];
+                if (!pch_stat(dep->file_name, &mtime, &size) || size != dep->size ||
+                    mtime.tv_sec != dep->mtime.tv_sec || mtime.tv_nsec != dep->mtime.tv_nsec)
+                        return false;
+        }
+        return true;
+}
+
+/*
+        Let the parses described by 'opts' include the shared PCH, if there is one and it was built
+        with the same compiler arguments, see parse_args(). A stale PCH is rebuilt first, an error
+        is raised if that fails; the pool is kept, and rebuilt again by the next parse. The headers
+        are only checked once per call, eg. once for all the files of parseAll(). The arguments
+        and the pool are anchored in the table at 'anchor'.
+*/
+static void apply_pch(lua_State *L, int anchor, parse_options *opts)
+{
+        lua_getfield(L, LUA_REGISTRYINDEX, PCH_POOL);
+        pch_pool *pool = (pch_pool *) lua_touserdata(L, -1);
+        bool same_args = pool != NULL && pool->num_args == opts->num_args;
+        for (int i = 0; same_args && i < opts->num_args; i++)
+                same_args = strcmp(pool->args[i], opts->args[i]) == 0;
+        if (!same_args) {
+                lua_pop(L, 1);
+                return;
+        }
+        const char *err = pch_is_fresh(pool) ? NULL : pch_build(pool);
+        if (err != NULL)
+                luaL_error(L, "%s", err);
+        lua_setfield(L, anchor, "pch");
+        const char **args = (const char **) lua_newuserdata(L, (opts->num_args + 3) * sizeof(const char *));
+        for (int i = 0; i < opts->num_args; i++)
+                args[i] = opts->args[i];
+        args[opts->num_args] = "-include-pch";
+        args[opts->num_args + 1] = pool->pch_file;
+        opts->pch = pool;
+        opts->pch_args = args;
+        lua_setfield(L, anchor, "pchArgs");
+}
+
+static bool is_blank(char c)
+{
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+/* Skip the white space and the comments at 's', up to 'end' */
+static const char *skip_blanks(const char *s, const char *end)
+{
+        while (s < end) {
+                if (is_blank(*s)) {
+                        s++;
+                } else if (end - s >= 2 && s[0] == '/' && s[1] == '/') {
+                        while (s < end && *s != '\n')
+                                s++;
+                } else if (end - s >= 2 && s[0] == '/' && s[1] == '*') {
+                        for (s += 2; end - s >= 2 && (s[0] != '*' || s[1] != '/'); s++)
+                                ;
+                        s = end - s >= 2 ? s + 2 : end;
+                } else {
+                        break;
+                }
+        }
+        return s;
+}
+
+/*
+        Check whether the source 's' of 'size' bytes starts by including the headers of the PCH, in
+        the same order. Only comments may come before and between the #include directives.
+*/
+static bool pch_is_prefix(const pch_pool *pool, const char *s, size_t size)
+{
+        const char *end = s + size;
+        for (int i = 0; i < pool->num_includes; i++) {
+                s = skip_blanks(s, end);
+                if (s == end || *s++ != '#')
+                        return false;
+                while (s < end && (*s == ' ' || *s == '\t'))
+                        s++;
+                if (end - s < 7 || strncmp(s, "include", 7) != 0)
+                        return false;
+                s += 7;
+                while (s < end && (*s == ' ' || *s == '\t'))
+                        s++;
+                if (s == end || (*s != '<' && *s != '"'))
+                        return false;
+                char close = *s++ == '<' ? '>' : '"';
+                size_t len = strlen(pool->includes[i]);
+                if ((size_t) (end - s) <= len || strncmp(s, pool->includes[i], len) != 0 || s[len] != close)
+                        return false;
+                s += len + 1;
+        }
+        return true;
+}
+
+/*
+        Return the compiler arguments 'file_name' is parsed with, setting their number in 'num_args',
+        which is larger than opts->num_args when the shared PCH is included. The callers creating
+        the index of the parse then keep the declarations of the PCH, so it doesn't change what
+        the parser sees. The PCH is only included if the file starts by including its headers, else the
+        file would see declarations and macros it doesn't include, and the macros it defines
+        before including the headers, eg. _GNU_SOURCE, would be ignored. Doesn't use the Lua
+        state, as parseAll() calls it from its worker threads.
+*/
+static const char **parse_args(const parse_options *opts, const char *file_name, int *num_args)
+{
+        *num_args = opts->num_args;
+        if (opts->pch == NULL)
+                return opts->args;
+        bool is_prefix = false;
+        unsigned i;
+        for (i = 0; i < opts->num_unsaved; i++) {
+                if (strcmp(opts->unsaved[i].Filename, file_name) == 0) {
+                        is_prefix = pch_is_prefix(opts->pch, opts->unsaved[i].Contents, opts->unsaved[i].Length);
+                        break;
+                }
+        }
+        if (i == opts->num_unsaved) {
+                size_t size;
+                const char *data = map_file(file_name, &size);
+                if (data != NULL) {
+                        is_prefix = pch_is_prefix(opts->pch, data, size);
+                        unmap_file(data, size);
+                }
+        }
+        if (!is_prefix)
+                return opts->args;
+        *num_args += 2;
+        return opts->pch_args;
+}
+
+/*
+        Collect the unsaved files into 'anchor' (a table at the given stack position) :
+                1. 'source' - stack position of the contents of 'file_name', or 0
+                2. 'unsaved' - stack position of a table mapping file names to contents, or 0
+        The contents are not copied, the CXUnsavedFile array points into the Lua strings,
+        which are kept alive by the anchor table : the name of the unsaved file i (from 0) at
+        index 3 + 2 * i, its contents at index 4 + 2 * i.
+*/
+static void check_unsaved_files(lua_State *L, int arg, int anchor, int source, int unsaved,
+                                const char *file_name, parse_options *opts)
+{
+        unsigned count = source != 0 ? 1 : 0;
+        if (unsaved != 0) {
+                lua_pushnil(L);
+                while (lua_next(L, unsaved) != 0) {
+                        luaL_argcheck(L, lua_type(L, -2) == LUA_TSTRING && lua_type(L, -1) == LUA_TSTRING, arg,
+                                      "expect unsaved files mapping file names to contents");
+                        count++;
+                        lua_pop(L, 1);
+                }
+        }
+        opts->num_unsaved = count;
+        opts->unsaved = (struct CXUnsavedFile *) lua_newuserdata(L, (count + 1) * sizeof(struct CXUnsavedFile));
+        lua_rawseti(L, anchor, 2);
+        int n = 0;
+        if (source != 0) {
+                size_t len;
+                opts->unsaved[n].Filename = lua_pushstring(L, file_name);
+                lua_rawseti(L, anchor, 3);
+                opts->unsaved[n].Contents = lua_tolstring(L, source, &len);
+                opts->unsaved[n++].Length = len;
+                lua_pushvalue(L, source);
+                lua_rawseti(L, anchor, 4);
+        }
+        if (unsaved != 0) {
+                lua_pushnil(L);
+                while (lua_next(L, unsaved) != 0) {
+                        size_t len;
+                        opts->unsaved[n].Filename = lua_tostring(L, -2);
+                        opts->unsaved[n].Contents = lua_tolstring(L, -1, &len);
+                        opts->unsaved[n].Length = len;
+                        lua_rawseti(L, anchor, 4 + 2 * n);
+                        lua_pushvalue(L, -1);
+                        lua_rawseti(L, anchor, 3 + 2 * n++);
+                }
+        }
+}
+
+/*
+        Read the options table at 'arg' :
+                1. args - Array of compiler arguments, eg. {"-Iinclude", "-DNDEBUG", "-std=c99"}
+                2. source - Contents of 'file_name', which then doesn't have to exist on disk
+                3. unsaved - Table mapping further (virtual) file names to their contents
+                4. One boolean field per entry of parse_flags
+                5. usePCH - Whether to include the shared precompiled header, see parse_args() (default true)
+        Pushes a table anchoring the memory the options point into.
+*/
+static void check_parse_options(lua_State *L, int arg, const char *file_name, parse_options *opts)
+{
+        opts->args = NULL;
+        opts->num_args = 0;
+        opts->unsaved = NULL;
+        opts->num_unsaved = 0;
+        opts->flags = CXTranslationUnit_None;
+        opts->pch = NULL;
+        opts->pch_args = NULL;
+        lua_newtable(L);
+        int anchor = lua_gettop(L);
+        if (lua_isnoneornil(L, arg)) {
+                apply_pch(L, anchor, opts);
+                return;
+        }
+        luaL_checktype(L, arg, LUA_TTABLE);
+        for (int i = 0; parse_flags[i].name != NULL; i++) {
+                if (opt_boolean(L, arg, parse_flags[i].name, false))
+                        opts->flags |= parse_flags[i].flag;
+        }
+        lua_getfield(L, arg, "args");
+        if (!lua_isnil(L, -1)) {
+                luaL_argcheck(L, lua_istable(L, -1), arg, "expect a table of compiler arguments");
+                int num_args = luaL_len(L, -1);
+                opts->args = (const char **) lua_newuserdata(L, (num_args + 1) * sizeof(const char *));
+                for (int i = 1; i <= num_args; i++) {
+                        lua_rawgeti(L, -2, i);
+                        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, arg, "expect string compiler arguments");
+                        opts->args[i-1] = lua_tostring(L, -1);
+                        lua_pop(L, 1);
+                }
+                opts->num_args = num_args;
+                lua_rawseti(L, anchor, 1);
+        }
+        lua_getfield(L, arg, "source");
+        lua_getfield(L, arg, "unsaved");
+        int source = lua_isnil(L, -2) ? 0 : anchor + 2;
+        int unsaved = lua_isnil(L, -1) ? 0 : anchor + 3;
+        luaL_argcheck(L, source == 0 || lua_type(L, source) == LUA_TSTRING, arg, "expect source string");
+        luaL_argcheck(L, unsaved == 0 || lua_istable(L, unsaved), arg, "expect a table of unsaved files");
+        if (source != 0 || unsaved != 0)
+                check_unsaved_files(L, arg, anchor, source, unsaved, file_name, opts);
+        lua_settop(L, anchor);
+        if (opt_boolean(L, arg, "usePCH", true))
+                apply_pch(L, anchor, opts);
+}
+
+/* Check whether the contents of 'file_name' are provided as unsaved file */
+static bool is_unsaved_file(const parse_options *opts, const char *file_name)
+{
+        for (unsigned i = 0; i < opts->num_unsaved; i++) {
+                if (strcmp(opts->unsaved[i].Filename, file_name) == 0)
+                        return true;
+        }
+        return false;
+}
+
+/*
+        Push a parser object without translation unit. 'index_arg' is the stack position
+        of the shared index object owning 'idx', or 0 if the parser owns 'idx'. The
+        parser keeps its index alive through its uservalue table.
+*/
+static clang_parser *new_parser(lua_State *L, CXIndex idx, int index_arg)
+{
+        clang_parser *parser;
+        new_object(L, parser, PARSER_METATABLE);
+        parser->idx = idx;
+        parser->index = NULL;
+        parser->tu = NULL;
+        parser->unsaved = NULL;
+        parser->num_unsaved = 0;
+        parser->types = NULL;
+        parser->decls = NULL;
+        memset(&parser->stats, 0, sizeof(parser->stats));
+        lua_createtable(L, 0, 2);
+        if (index_arg != 0) {
+                parser->index = (clang_index *) lua_touserdata(L, index_arg);
+                parser->index->num_parsers++;
+                lua_pushvalue(L, index_arg);
+                lua_setfield(L, -2, "index");
+        }
+        lua_setuservalue(L, -2);
+        return parser;
+}
+
+/*
+        Parse 'file_name' and push the parser object, see new_parser(). The parser keeps
+        the anchor of the options on top of the stack alive. If 'idx' is NULL, the parser
+        creates its own index.
+*/
+static int push_parser(lua_State *L, CXIndex idx, int index_arg, const char *file_name, const parse_options *opts)
+{
+        int anchor = lua_gettop(L);
+        int num_args;
+        const char **args = parse_args(opts, file_name, &num_args);
+        if (idx == NULL) {
+                /* the declarations of the shared PCH stay visible, it only makes the parse faster */
+                idx = clang_createIndex(num_args == opts->num_args, 0);
+                luaL_argcheck(L, idx != NULL, 1, "index wasn't created");
+        }
+        clang_parser *parser = new_parser(L, idx, index_arg);
+        parser->unsaved = opts->unsaved;
+        parser->num_unsaved = opts->num_unsaved;
+        lua_getuservalue(L, -1);
+        lua_pushvalue(L, anchor);
+        lua_setfield(L, -2, "options");
+        lua_pop(L, 1);
+        double start = now();
+        parser->tu = clang_parseTranslationUnit(idx, file_name, args, num_args,
+                                                opts->unsaved, opts->num_unsaved, opts->flags);
+        parser->stats.parse_time = now() - start;
+        parser->stats.used_pch = num_args != opts->num_args;
+        luaL_argcheck(L, parser->tu != NULL, 1, "translation unit wasn't created");
+        register_parser(L, -1, parser->tu);
+        return 1;
+}
+
+/* Load the translation unit saved in 'ast_file' and push the parser object, see new_parser() */
+static int push_loaded_parser(lua_State *L, CXIndex idx, int index_arg, const char *ast_file)
+{
+        clang_parser *parser = new_parser(L, idx, index_arg);
+        double start = now();
+        enum CXErrorCode err = clang_createTranslationUnit2(idx, ast_file, &parser->tu);
+        parser->stats.parse_time = now() - start;
+        luaL_argcheck(L, err == CXError_Success && parser->tu != NULL, 1, "translation unit wasn't created");
+        register_parser(L, -1, parser->tu);
+        return 1;
+}
+
 /* --Clang functions-- */
 
 /*      
-        Format - luaclang.newParser(file_name)
-        Parameter - file_name - The name of the source file to load 
+        Format - luaclang.newParser(file_name [, options])
+        Parameters - file_name - The name of the source file to load 
+                   - options - Optional table with the fields :
+                        1. args - Array of compiler arguments, eg. {"-Iinclude", "-DNDEBUG", "-std=c99"}
+                        2. source - Contents of the source file, which is then parsed from memory
+                        3. unsaved - Table mapping (virtual) file names to their contents, eg. {["config.h"] = "#define X 1"}
+                        4. skipFunctionBodies, incomplete, keepGoing, singleFileParse, limitSkipFunctionBodiesToPreamble,
+                           precompiledPreamble, detailedPreprocessingRecord - Booleans enabling the
+                           CXTranslationUnit flag of the same name. With precompiledPreamble, parser:reparse()
+                           only re-parses what follows the preamble. detailedPreprocessingRecord exposes the
+                           macro definitions, see parser:getMacros().
+                        5. usePCH - Include the shared precompiled header set by luaclang.usePCH() when the
+                           compiler arguments match and the file starts by including its headers (default true)
         More info - 1. https://clang.llvm.org/doxygen/group__CINDEX.html#ga51eb9b38c18743bf2d824c6230e61f93
                     2. https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html#ga2baf83f8c3299788234c8bce55e4472e
+                    3. https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
         Returns clang object whose translation unit cursor can be obtained.
 */
 static int clang_newparser(lua_State *L)
 {
-        const char *file_name = lua_tostring(L, 1);
-        if (access(file_name, F_OK) == -1) {
+        const char *file_name = luaL_checkstring(L, 1);
+        parse_options opts;
+        check_parse_options(L, 2, file_name, &opts);
+        if (!is_unsaved_file(&opts, file_name) && access(file_name, F_OK) == -1) {
              return luaL_error(L, "file doesn't exist");    
         }
-        clang_parser *parser;
-        new_object(L, parser, PARSER_METATABLE);
-        parser->idx = clang_createIndex(1, 0);
-        luaL_argcheck(L, parser->idx != NULL, 1, "index wasn't created");
-        const char *args[] = {file_name};
-        parser->tu = clang_parseTranslationUnit(parser->idx, 0, args, 1, 0, 0, CXTranslationUnit_None);
-        luaL_argcheck(L, parser->tu != NULL, 1, "translation unit wasn't created");
+        return push_parser(L, NULL, 0, file_name, &opts);
+}
+
+/*
+        Format - luaclang.newIndex([options])
+        Parameter - options - Optional table with the fields :
+                        1. excludeDeclarationsFromPCH - Exclude declarations coming from precompiled headers (default true),
+                           the parses of such an index don't use the PCH of luaclang.usePCH()
+                        2. displayDiagnostics - Print diagnostics to stderr while parsing (default false)
+                        3. threadBackgroundPriorityForIndexing - Run indexing threads with background priority
+                        4. threadBackgroundPriorityForEditing - Run editing (reparse) threads with background priority
+        More info - 1. https://clang.llvm.org/doxygen/group__CINDEX.html#ga51eb9b38c18743bf2d824c6230e61f93
+                    2. https://clang.llvm.org/doxygen/group__CINDEX.html
+        Returns an index object which can be shared by any number of parsers
+*/
+static int clang_newindex(lua_State *L)
+{
+        if (!lua_isnoneornil(L, 1))
+                luaL_checktype(L, 1, LUA_TTABLE);
+        bool exclude_pch = opt_boolean(L, 1, "excludeDeclarationsFromPCH", true);
+        bool display_diags = opt_boolean(L, 1, "displayDiagnostics", false);
+        unsigned global_opts = CXGlobalOpt_None;
+        if (opt_boolean(L, 1, "threadBackgroundPriorityForIndexing", false))
+                global_opts |= CXGlobalOpt_ThreadBackgroundPriorityForIndexing;
+        if (opt_boolean(L, 1, "threadBackgroundPriorityForEditing", false))
+                global_opts |= CXGlobalOpt_ThreadBackgroundPriorityForEditing;
+        clang_index *index;
+        new_object(L, index, INDEX_METATABLE);
+        index->num_parsers = 0;
+        index->dispose_pending = false;
+        index->exclude_pch = exclude_pch;
+        index->idx = clang_createIndex(exclude_pch, display_diags);
+        luaL_argcheck(L, index->idx != NULL, 1, "index wasn't created");
+        clang_CXIndex_setGlobalOptions(index->idx, global_opts);
+        return 1;
+}
+
+/*
+        Format - luaclang.loadParser(ast_file)
+        Parameter - ast_file - AST file written by parser:save()
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns clang object whose translation unit was deserialized from the AST file
+*/
+static int clang_loadparser(lua_State *L)
+{
+        const char *ast_file = luaL_checkstring(L, 1);
+        if (access(ast_file, F_OK) == -1) {
+             return luaL_error(L, "file doesn't exist");
+        }
+        CXIndex idx = clang_createIndex(1, 0);
+        luaL_argcheck(L, idx != NULL, 1, "index wasn't created");
+        return push_loaded_parser(L, idx, 0, ast_file);
+}
+
+/*
+        Format - luaclang.usePCH(pch_file, includes [, options]) or luaclang.usePCH(nil)
+        Parameters - pch_file - File the precompiled header is written to
+                   - includes - Array of the common headers, each included as #include <name>, eg. {"stdint.h", "stdio.h"}
+                   - options - Optional table with the field :
+                        args - Array of compiler arguments the PCH is built with
+        The headers are parsed once and saved as a precompiled header, which every parser created
+        afterwards with exactly the same compiler arguments includes through -include-pch, unless its
+        usePCH option is false. Only source files which start by including the same headers in the
+        same order, with nothing but comments before and between the #include directives, use the
+        PCH : a file which doesn't include them, or defines a macro such as _GNU_SOURCE first, is
+        parsed without it. Before each such parse the modification times and sizes of the headers
+        are checked, the PCH is rebuilt if any of them changed, and the parse raises the error if
+        the rebuild fails. The parsers keep the declarations and macros of the PCH, so it only
+        makes parsing faster; the file names of its headers are absolute though, and the #include
+        directives of the generated header are visited too. As the indexes created by luaclang.newIndex() with
+        excludeDeclarationsFromPCH (the default) would hide them, their parses don't use the PCH.
+        usePCH(nil) stops using the PCH.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns an array of the headers the PCH depends on
+*/
+static int clang_usepch(lua_State *L)
+{
+        if (lua_isnoneornil(L, 1)) {
+                lua_pushnil(L);
+                lua_setfield(L, LUA_REGISTRYINDEX, PCH_POOL);
+                return 0;
+        }
+        const char *pch_file = luaL_checkstring(L, 1);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        if (!lua_isnoneornil(L, 3))
+                luaL_checktype(L, 3, LUA_TTABLE);
+        luaL_Buffer source;
+        luaL_buffinit(L, &source);
+        int num_includes = luaL_len(L, 2);
+        for (int i = 1; i <= num_includes; i++) {
+                lua_rawgeti(L, 2, i);
+                luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 2, "expect an array of header names");
+                lua_pop(L, 1);
+                luaL_addstring(&source, "#include <");
+                lua_rawgeti(L, 2, i);
+                luaL_addvalue(&source);
+                luaL_addstring(&source, ">\n");
+        }
+        luaL_pushresult(&source);
+        int header = lua_gettop(L);
+        int num_args = 0;
+        if (!lua_isnoneornil(L, 3)) {
+                lua_getfield(L, 3, "args");
+                if (!lua_isnil(L, -1)) {
+                        luaL_argcheck(L, lua_istable(L, -1), 3, "expect a table of compiler arguments");
+                        num_args = luaL_len(L, -1);
+                        for (int i = 1; i <= num_args; i++) {
+                                luaL_argcheck(L, lua_rawgeti(L, -1, i) == LUA_TSTRING, 3,
+                                              "expect string compiler arguments");
+                                lua_pop(L, 1);
+                        }
+                }
+        }
+        int args = lua_gettop(L);
+        pch_pool *pool;
+        new_object(L, pool, PCH_POOL_METATABLE);
+        memset(pool, 0, sizeof(*pool));
+        pool->pch_file = strdup(pch_file);
+        pool->source = strdup(lua_tostring(L, header));
+        pool->args = (char **) calloc(num_args + 1, sizeof(char *));
+        pool->includes = (char **) calloc(num_includes + 1, sizeof(char *));
+        if (pool->pch_file == NULL || pool->source == NULL || pool->args == NULL || pool->includes == NULL)
+                return luaL_error(L, "not enough memory");
+        for (; pool->num_includes < num_includes; pool->num_includes++) {
+                lua_rawgeti(L, 2, pool->num_includes + 1);
+                pool->includes[pool->num_includes] = strdup(lua_tostring(L, -1));
+                lua_pop(L, 1);
+                if (pool->includes[pool->num_includes] == NULL)
+                        return luaL_error(L, "not enough memory");
+        }
+        for (; pool->num_args < num_args; pool->num_args++) {
+                lua_rawgeti(L, args, pool->num_args + 1);
+                pool->args[pool->num_args] = strdup(lua_tostring(L, -1));
+                lua_pop(L, 1);
+                if (pool->args[pool->num_args] == NULL)
+                        return luaL_error(L, "not enough memory");
+        }
+        const char *err = pch_build(pool);
+        if (err != NULL)
+                return luaL_error(L, "%s", err);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, LUA_REGISTRYINDEX, PCH_POOL);
+        lua_createtable(L, pool->num_deps, 0);
+        for (unsigned i = 0; i < pool->num_deps; i++) {
+                lua_pushstring(L, pool->deps[i].file_name);
+                lua_rawseti(L, -2, i + 1);
+        }
         return 1;
 }
 
-/*      
-        Format - luaclang.getNullCursor()
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga94d81bbf40dff4ac843458d018f3138e
-        Returns a null cursor
-*/
-static int clang_getnullcursor(lua_State *L)
+/* Return the description of a clang_parseTranslationUnit2() error */
+static const char *parse_error_str(enum CXErrorCode err)
+{
+        switch (err) {
+                case CXError_Crashed:
+                        return "parser crashed";
+                case CXError_InvalidArguments:
+                        return "invalid arguments";
+                default:
+                        return "translation unit wasn't created";
+        }
+}
+
+/* Translation unit parsed by a worker thread of luaclang.parseAll() */
+typedef struct parse_job {
+        const char *file_name;  /* NULL if the job isn't to be run */
+        CXIndex idx;
+        CXTranslationUnit tu;
+        enum CXErrorCode err;
+        double parse_time;
+        bool used_pch;
+} parse_job;
+
+/* Jobs of luaclang.parseAll(), a userdata whose __gc releases the translation units not handed over to parsers */
+typedef struct parse_job_list {
+        int num_jobs;
+        parse_job jobs[];
+} parse_job_list;
+
+static int parse_jobs_gc(lua_State *L)
+{
+        parse_job_list *list = (parse_job_list *) lua_touserdata(L, 1);
+        for (int i = 0; i < list->num_jobs; i++) {
+                if (list->jobs[i].tu != NULL)
+                        clang_disposeTranslationUnit(list->jobs[i].tu);
+                if (list->jobs[i].idx != NULL)
+                        clang_disposeIndex(list->jobs[i].idx);
+        }
+        list->num_jobs = 0;
+        return 0;
+}
+
+/* Work shared by the worker threads, which never touch the Lua state */
+typedef struct parse_queue {
+        parse_job *jobs;
+        int num_jobs;
+        int next;               /* next job to be taken, guarded by 'lock' */
+        pthread_mutex_t lock;
+        const parse_options *opts;
+} parse_queue;
+
+static void *parse_worker(void *arg)
+{
+        parse_queue *queue = (parse_queue *) arg;
+        const parse_options *opts = queue->opts;
+        for (;;) {
+                pthread_mutex_lock(&queue->lock);
+                int i = queue->next++;
+                pthread_mutex_unlock(&queue->lock);
+                if (i >= queue->num_jobs)
+                        return NULL;
+                parse_job *job = &queue->jobs[i];
+                if (job->file_name == NULL)
+                        continue;
+                int num_args;
+                const char **args = parse_args(opts, job->file_name, &num_args);
+                job->used_pch = num_args != opts->num_args;
+                job->idx = clang_createIndex(!job->used_pch, 0);
+                if (job->idx == NULL) {
+                        job->err = CXError_Failure;
+                        continue;
+                }
+                double start = now();
+                job->err = clang_parseTranslationUnit2(job->idx, job->file_name, args, num_args,
+                                                       opts->unsaved, opts->num_unsaved, opts->flags, &job->tu);
+                job->parse_time = now() - start;
+                if (job->err == CXError_Success && job->tu == NULL)
+                        job->err = CXError_Failure;
+        }
+}
+
+/*
+        Format - luaclang.parseAll(files [, options])
+        Parameters - files - Array of the names of the source files to parse
+                   - options - Optional table, as accepted by luaclang.newParser() except for source, and :
+                        threads - Number of worker threads (default the number of online processors)
+        The files are parsed concurrently, each in its own index. The Lua state is only used
+        by the calling thread, which waits until every file is parsed.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns an array holding the parser object of each file, or false if it couldn't be parsed,
+                and a table mapping the position of each such file to the error message
+*/
+static int clang_parseall(lua_State *L)
+{
+        luaL_checktype(L, 1, LUA_TTABLE);
+        long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        if (!lua_isnoneornil(L, 2)) {
+                luaL_checktype(L, 2, LUA_TTABLE);
+                lua_getfield(L, 2, "source");
+                luaL_argcheck(L, lua_isnil(L, -1), 2, "source isn't supported by parseAll");
+                lua_getfield(L, 2, "threads");
+                if (!lua_isnil(L, -1)) {
+                        luaL_argcheck(L, lua_isinteger(L, -1) && lua_tointeger(L, -1) > 0, 2,
+                                      "expect a positive number of threads");
+                        threads = lua_tointeger(L, -1);
+                }
+                lua_pop(L, 2);
+        }
+        parse_options opts;
+        check_parse_options(L, 2, NULL, &opts);
+        int anchor = lua_gettop(L);
+        int num_files = luaL_len(L, 1);
+        parse_queue queue;
+        parse_job_list *list;
+        list = (parse_job_list *) lua_newuserdata(L, sizeof(parse_job_list) + (num_files + 1) * sizeof(parse_job));
+        memset(list, 0, sizeof(parse_job_list) + (num_files + 1) * sizeof(parse_job));
+        list->num_jobs = num_files;
+        luaL_setmetatable(L, PARSE_JOBS_METATABLE);
+        queue.jobs = list->jobs;
+        queue.num_jobs = num_files;
+        queue.next = 0;
+        queue.opts = &opts;
+        lua_createtable(L, num_files, 0);
+        lua_newtable(L);
+        int parsers = anchor + 2, errors = anchor + 3;
+        for (int i = 0; i < num_files; i++) {
+                parse_job *job = &queue.jobs[i];
+                lua_rawgeti(L, 1, i+1);
+                luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 1, "expect an array of file names");
+                job->file_name = lua_tostring(L, -1);
+                job->idx = NULL;
+                job->tu = NULL;
+                job->err = CXError_Failure;
+                lua_pop(L, 1);  /* still referenced by 'files' */
+                if (!is_unsaved_file(&opts, job->file_name) && access(job->file_name, F_OK) == -1) {
+                        job->file_name = NULL;
+                        lua_pushliteral(L, "file doesn't exist");
+                        lua_rawseti(L, errors, i+1);
+                }
+        }
+        if (threads > num_files)
+                threads = num_files;
+        pthread_t *workers = (pthread_t *) lua_newuserdata(L, (threads + 1) * sizeof(pthread_t));
+        pthread_mutex_init(&queue.lock, NULL);
+        int started = 0;
+        while (started < threads && pthread_create(&workers[started], NULL, parse_worker, &queue) == 0)
+                started++;
+        parse_worker(&queue);   /* takes over the remaining jobs, if a thread couldn't be created */
+        for (int i = 0; i < started; i++)
+                pthread_join(workers[i], NULL);
+        pthread_mutex_destroy(&queue.lock);
+        lua_pop(L, 1);
+        for (int i = 0; i < num_files; i++) {
+                parse_job *job = &queue.jobs[i];
+                if (job->file_name == NULL) {
+                        lua_pushboolean(L, false);
+                } else if (job->err != CXError_Success) {
+                        if (job->idx != NULL)
+                                clang_disposeIndex(job->idx);
+                        job->idx = NULL;
+                        lua_pushstring(L, parse_error_str(job->err));
+                        lua_rawseti(L, errors, i+1);
+                        lua_pushboolean(L, false);
+                } else {
+                        clang_parser *parser = new_parser(L, job->idx, 0);
+                        parser->tu = job->tu;
+                        job->idx = NULL;
+                        job->tu = NULL;
+                        parser->stats.parse_time = job->parse_time;
+                        parser->stats.used_pch = job->used_pch;
+                        register_parser(L, -1, parser->tu);
+                        parser->unsaved = opts.unsaved;
+                        parser->num_unsaved = opts.num_unsaved;
+                        lua_getuservalue(L, -1);
+                        lua_pushvalue(L, anchor);
+                        lua_setfield(L, -2, "options");
+                        lua_pop(L, 1);
+                }
+                lua_rawseti(L, parsers, i+1);
+        }
+        lua_settop(L, errors);
+        return 2;
+}
+
+/*
+        Parse running on a background thread for luaclang.parseAsync(). It is shared by the
+        thread and the handle object and freed by whichever releases it last. The thread only
+        uses copies of the options, never the Lua state.
+*/
+typedef struct async_parse {
+        pthread_mutex_t lock;
+        pthread_cond_t finished;
+        int refs;               /* the thread and the handle, guarded by 'lock' */
+        bool done;              /* guarded by 'lock' */
+        int fds[2];             /* pipe, a byte is written to fds[1] once done */
+        char *file_name;
+        char **args;
+        int num_args;
+        struct CXUnsavedFile *unsaved;
+        unsigned num_unsaved;
+        unsigned flags;
+        bool exclude_pch;       /* no shared PCH is included, see push_parser() */
+        CXIndex idx;            /* owned by the job until the parser object is created */
+        CXTranslationUnit tu;
+        enum CXErrorCode err;
+        double parse_time;
+} async_parse;
+
+/* Number of parse threads still running, which the module must outlive */
+static pthread_mutex_t running_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t running_done = PTHREAD_COND_INITIALIZER;
+static int running_parses = 0;
+
+typedef struct parse_handle {
+        async_parse *job;       /* NULL once the result was taken or the parse cancelled */
+        bool cancelled;
+        struct CXUnsavedFile *unsaved;  /* unsaved files anchored in the uservalue, for the parser */
+        unsigned num_unsaved;
+} parse_handle;
+
+static void async_parse_free(async_parse *job)
+{
+        if (job->tu != NULL)
+                clang_disposeTranslationUnit(job->tu);
+        if (job->idx != NULL)
+                clang_disposeIndex(job->idx);
+        for (int i = 0; i < job->num_args; i++)
+                free(job->args[i]);
+        for (unsigned i = 0; i < job->num_unsaved; i++) {
+                free((char *) job->unsaved[i].Filename);
+                free((char *) job->unsaved[i].Contents);
+        }
+        free(job->args);
+        free(job->unsaved);
+        free(job->file_name);
+        close(job->fds[0]);
+        close(job->fds[1]);
+        pthread_cond_destroy(&job->finished);
+        pthread_mutex_destroy(&job->lock);
+        free(job);
+}
+
+static void async_parse_release(async_parse *job)
+{
+        pthread_mutex_lock(&job->lock);
+        int refs = --job->refs;
+        pthread_mutex_unlock(&job->lock);
+        if (refs == 0)
+                async_parse_free(job);
+}
+
+static void *async_parse_thread(void *arg)
+{
+        async_parse *job = (async_parse *) arg;
+        job->idx = clang_createIndex(job->exclude_pch, 0);
+        if (job->idx == NULL) {
+                job->err = CXError_Failure;
+        } else {
+                double start = now();
+                job->err = clang_parseTranslationUnit2(job->idx, job->file_name, (const char *const *) job->args,
+                                                       job->num_args, job->unsaved, job->num_unsaved,
+                                                       job->flags, &job->tu);
+                job->parse_time = now() - start;
+                if (job->err == CXError_Success && job->tu == NULL)
+                        job->err = CXError_Failure;
+        }
+        pthread_mutex_lock(&job->lock);
+        job->done = true;
+        pthread_cond_broadcast(&job->finished);
+        pthread_mutex_unlock(&job->lock);
+        char byte = 1;
+        if (write(job->fds[1], &byte, 1) < 0) {
+                /* nobody can be waiting on a full or closed pipe */
+        }
+        async_parse_release(job);
+        pthread_mutex_lock(&running_lock);
+        running_parses--;
+        pthread_cond_broadcast(&running_done);
+        pthread_mutex_unlock(&running_lock);
+        return NULL;
+}
+
+/* __gc of a module sentinel : the library is unloaded when the Lua state is closed, wait for the threads first */
+static int wait_running_parses(lua_State *L)
+{
+        pthread_mutex_lock(&running_lock);
+        while (running_parses > 0)
+                pthread_cond_wait(&running_done, &running_lock);
+        pthread_mutex_unlock(&running_lock);
+        return 0;
+}
+
+/* Copy the strings the options point into, as the Lua ones may be collected while the thread runs */
+static bool async_parse_copy_options(async_parse *job, const char *file_name, const parse_options *opts)
+{
+        int num_args;
+        const char **args = parse_args(opts, file_name, &num_args);
+        job->exclude_pch = num_args == opts->num_args;
+        job->file_name = strdup(file_name);
+        job->args = (char **) calloc(num_args + 1, sizeof(char *));
+        job->unsaved = (struct CXUnsavedFile *) calloc(opts->num_unsaved + 1, sizeof(struct CXUnsavedFile));
+        if (job->file_name == NULL || job->args == NULL || job->unsaved == NULL)
+                return false;
+        for (; job->num_args < num_args; job->num_args++) {
+                job->args[job->num_args] = strdup(args[job->num_args]);
+                if (job->args[job->num_args] == NULL)
+                        return false;
+        }
+        for (; job->num_unsaved < opts->num_unsaved; job->num_unsaved++) {
+                const struct CXUnsavedFile *file = &opts->unsaved[job->num_unsaved];
+                struct CXUnsavedFile *copy = &job->unsaved[job->num_unsaved];
+                char *contents = (char *) malloc(file->Length + 1);
+                copy->Filename = strdup(file->Filename);
+                copy->Contents = contents;
+                copy->Length = file->Length;
+                if (copy->Filename == NULL || contents == NULL) {
+                        free((char *) copy->Filename);
+                        free(contents);
+                        return false;
+                }
+                memcpy(contents, file->Contents, file->Length);
+        }
+        job->flags = opts->flags;
+        return true;
+}
+
+/*
+        Format - luaclang.parseAsync(file_name [, options])
+        Parameters - file_name - The name of the source file to parse
+                   - options - Optional table, as accepted by luaclang.newParser()
+        The file is parsed on a background thread. The returned handle has the methods :
+                1. ready() - Whether the parse has finished
+                2. wait([seconds]) - Block until the parse has finished, or at most 'seconds', and return ready()
+                3. result() - Wait for the parse and return the parser object, which is created once
+                4. cancel() - Discard the parse, its translation unit is disposed as soon as the thread is done
+                5. fd() - File descriptor which becomes readable once the parse has finished, for event loops
+        A running clang parse can't be interrupted, dropping or cancelling a handle only discards its result.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns the handle of the parse
+*/
+static int clang_parseasync(lua_State *L)
+{
+        const char *file_name = luaL_checkstring(L, 1);
+        parse_options opts;
+        check_parse_options(L, 2, file_name, &opts);
+        if (!is_unsaved_file(&opts, file_name) && access(file_name, F_OK) == -1) {
+             return luaL_error(L, "file doesn't exist");
+        }
+        parse_handle *handle;
+        new_object(L, handle, PARSE_HANDLE_METATABLE);
+        handle->job = NULL;
+        handle->cancelled = false;
+        handle->unsaved = opts.unsaved;
+        handle->num_unsaved = opts.num_unsaved;
+        lua_createtable(L, 0, 2);
+        lua_pushvalue(L, -3);
+        lua_setfield(L, -2, "options");
+        lua_setuservalue(L, -2);
+        async_parse *job = (async_parse *) calloc(1, sizeof(async_parse));
+        if (job == NULL)
+                return luaL_error(L, "not enough memory");
+        if (pipe(job->fds) != 0) {
+                free(job);
+                return luaL_error(L, "pipe couldn't be created");
+        }
+        pthread_mutex_init(&job->lock, NULL);
+        pthread_cond_init(&job->finished, NULL);
+        job->refs = 2;
+        if (!async_parse_copy_options(job, file_name, &opts)) {
+                async_parse_free(job);
+                return luaL_error(L, "not enough memory");
+        }
+        pthread_t thread;
+        pthread_mutex_lock(&running_lock);
+        if (pthread_create(&thread, NULL, async_parse_thread, job) != 0) {
+                pthread_mutex_unlock(&running_lock);
+                async_parse_free(job);
+                return luaL_error(L, "thread couldn't be created");
+        }
+        running_parses++;
+        pthread_mutex_unlock(&running_lock);
+        pthread_detach(thread);
+        handle->job = job;
+        return 1;
+}
+
+/*      
+        Format - luaclang.getNullCursor()
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga94d81bbf40dff4ac843458d018f3138e
+        Returns a null cursor
+*/
+static int clang_getnullcursor(lua_State *L)
+{
+        push_cursor(L, clang_getNullCursor());
+        return 1;
+}
+
+/* --Index functions-- */
+
+/*
+        Format - index:newParser(file_name [, options])
+        Parameters - index - Index object the translation unit is created in
+                   - file_name - The name of the source file to load
+                   - options - Optional table, as accepted by luaclang.newParser()
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html#ga2baf83f8c3299788234c8bce55e4472e
+        Returns clang object sharing the index, whose translation unit cursor can be obtained.
+*/
+static int index_newparser(lua_State *L)
+{
+        clang_index *index;
+        to_object(L, index, INDEX_METATABLE, 1);
+        luaL_argcheck(L, index->idx != NULL && !index->dispose_pending, 1, "index object was disposed");
+        const char *file_name = luaL_checkstring(L, 2);
+        parse_options opts;
+        check_parse_options(L, 3, file_name, &opts);
+        if (index->exclude_pch)
+                opts.pch = NULL;        /* the index would hide its declarations */
+        if (!is_unsaved_file(&opts, file_name) && access(file_name, F_OK) == -1) {
+             return luaL_error(L, "file doesn't exist");
+        }
+        return push_parser(L, index->idx, 1, file_name, &opts);
+}
+
+/*
+        Format - index:loadParser(ast_file)
+        Parameters - index - Index object the translation unit is loaded in
+                   - ast_file - AST file written by parser:save()
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns clang object sharing the index, whose translation unit was deserialized from the AST file
+*/
+static int index_loadparser(lua_State *L)
+{
+        clang_index *index;
+        to_object(L, index, INDEX_METATABLE, 1);
+        luaL_argcheck(L, index->idx != NULL && !index->dispose_pending, 1, "index object was disposed");
+        const char *ast_file = luaL_checkstring(L, 2);
+        if (access(ast_file, F_OK) == -1) {
+             return luaL_error(L, "file doesn't exist");
+        }
+        return push_loaded_parser(L, index->idx, 1, ast_file);
+}
+
+/*
+        Format - index:setGlobalOptions(options)
+        Parameters - index - Index object whose options are to be changed
+                   - options - Table with the boolean fields threadBackgroundPriorityForIndexing
+                               and threadBackgroundPriorityForEditing
+        More info - https://clang.llvm.org/doxygen/group__CINDEX.html
+        Returns nothing
+*/
+static int index_setglobaloptions(lua_State *L)
+{
+        clang_index *index;
+        to_object(L, index, INDEX_METATABLE, 1);
+        luaL_argcheck(L, index->idx != NULL && !index->dispose_pending, 1, "index object was disposed");
+        luaL_checktype(L, 2, LUA_TTABLE);
+        unsigned global_opts = CXGlobalOpt_None;
+        if (opt_boolean(L, 2, "threadBackgroundPriorityForIndexing", false))
+                global_opts |= CXGlobalOpt_ThreadBackgroundPriorityForIndexing;
+        if (opt_boolean(L, 2, "threadBackgroundPriorityForEditing", false))
+                global_opts |= CXGlobalOpt_ThreadBackgroundPriorityForEditing;
+        clang_CXIndex_setGlobalOptions(index->idx, global_opts);
+        return 0;
+}
+
+/*
+        Format - index:getGlobalOptions()
+        Parameter - index - Index object whose options are to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX.html
+        Returns a table with the boolean fields threadBackgroundPriorityForIndexing and threadBackgroundPriorityForEditing
+*/
+static int index_getglobaloptions(lua_State *L)
+{
+        clang_index *index;
+        to_object(L, index, INDEX_METATABLE, 1);
+        luaL_argcheck(L, index->idx != NULL && !index->dispose_pending, 1, "index object was disposed");
+        unsigned global_opts = clang_CXIndex_getGlobalOptions(index->idx);
+        lua_newtable(L);
+        lua_pushboolean(L, global_opts & CXGlobalOpt_ThreadBackgroundPriorityForIndexing);
+        lua_setfield(L, -2, "threadBackgroundPriorityForIndexing");
+        lua_pushboolean(L, global_opts & CXGlobalOpt_ThreadBackgroundPriorityForEditing);
+        lua_setfield(L, -2, "threadBackgroundPriorityForEditing");
+        return 1;
+}
+
+/*
+        Format - index:dispose()
+        Parameter - index - Index object to be disposed
+        The index is released once the last parser created from it is disposed.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX.html
+        Returns nothing
+*/
+static int index_dispose(lua_State *L)
+{
+        clang_index *index;
+        to_object(L, index, INDEX_METATABLE, 1);
+        index->dispose_pending = true;
+        index_release(index);
+        return 0;
+}
+
+/* --Parser functions-- */
+
+/*      
+        Format - parser:dispose()
+        Parameter - parser - Clang object to be disposed
+        More info - 1. https://clang.llvm.org/doxygen/group__CINDEX.html#ga51eb9b38c18743bf2d824c6230e61f93
+                    2. https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html#ga2baf83f8c3299788234c8bce55e4472e
+        Returns nothing
+*/
+static int parser_dispose(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        if (parser->idx == NULL) return 0;
+        free_type_table(parser);
+        free_decl_index(parser);
+        if (parser->tu != NULL) {
+                drop_caches(L, parser->tu);
+                unregister_parser(L, parser->tu);
+                clang_disposeTranslationUnit(parser->tu);
+        }
+        if (parser->index == NULL) {
+                clang_disposeIndex(parser->idx);
+        } else {
+                parser->index->num_parsers--;
+                index_release(parser->index);
+                parser->index = NULL;
+        }
+        parser->idx = NULL;
+        parser->tu = NULL;
+        return 0;
+}
+
+/*
+        Format - parser:reparse([unsaved])
+        Parameters - parser - Clang object whose translation unit is to be reparsed
+                   - unsaved - Optional table mapping file names to their current contents, the
+                               unsaved files of the previous parse (including the source given to
+                               newParser()) are kept unless they are given new contents
+        Cursors and types obtained before the reparse must not be used afterwards. If the
+        reparse fails, the translation unit is released and the parser behaves as disposed.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns nothing
+*/
+static int parser_reparse(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        if (!lua_isnoneornil(L, 2)) {
+                luaL_checktype(L, 2, LUA_TTABLE);
+                parse_options opts;
+                lua_newtable(L);
+                int merged = lua_gettop(L);
+                /* the previous contents are the strings anchored by the options, see check_unsaved_files() */
+                lua_getuservalue(L, 1);
+                lua_getfield(L, -1, "options");
+                for (unsigned i = 0; i < parser->num_unsaved; i++) {
+                        lua_rawgeti(L, -1, 3 + 2 * i);
+                        lua_rawgeti(L, -2, 4 + 2 * i);
+                        lua_rawset(L, merged);
+                }
+                lua_pop(L, 2);
+                lua_pushnil(L);
+                while (lua_next(L, 2) != 0) {
+                        lua_pushvalue(L, -2);
+                        lua_insert(L, -2);
+                        lua_rawset(L, merged);
+                }
+                lua_newtable(L);
+                check_unsaved_files(L, 2, lua_gettop(L), 0, merged, NULL, &opts);
+                lua_getuservalue(L, 1);
+                lua_pushvalue(L, -2);
+                lua_setfield(L, -2, "options");
+                parser->unsaved = opts.unsaved;
+                parser->num_unsaved = opts.num_unsaved;
+        }
+        drop_caches(L, parser->tu);
+        free_type_table(parser);
+        free_decl_index(parser);
+        lua_getuservalue(L, 1);
+        lua_pushnil(L);
+        lua_setfield(L, -2, "types");
+        lua_pop(L, 1);
+        double start = now();
+        int err = clang_reparseTranslationUnit(parser->tu, parser->num_unsaved, parser->unsaved,
+                                               clang_defaultReparseOptions(parser->tu));
+        parser->stats.parse_time = now() - start;
+        parser->stats.num_reparses++;
+        if (err != 0) {
+                unregister_parser(L, parser->tu);
+                clang_disposeTranslationUnit(parser->tu);
+                parser->tu = NULL;
+                return luaL_argerror(L, 1, "translation unit couldn't be reparsed");
+        }
+        return 0;
+}
+
+/* Return the description of a clang_saveTranslationUnit() error */
+static const char *save_error_str(int err)
+{
+        switch (err) {
+                case CXSaveError_TranslationErrors:
+                        return "translation unit has errors";
+                case CXSaveError_InvalidTU:
+                        return "invalid translation unit";
+                default:
+                        return "translation unit couldn't be saved";
+        }
+}
+
+/*
+        Format - parser:save(ast_file)
+        Parameters - parser - Clang object whose translation unit is to be saved
+                   - ast_file - Path of the AST file to write
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns nothing, the file can be loaded again with luaclang.loadParser()
+*/
+static int parser_save(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        const char *ast_file = luaL_checkstring(L, 2);
+        int err = clang_saveTranslationUnit(parser->tu, ast_file, clang_defaultSaveOptions(parser->tu));
+        luaL_argcheck(L, err == CXSaveError_None, 1, save_error_str(err));
+        return 0;
+}
+
+/*      
+        Format - parser:getCursor()
+        Parameter - parser - Clang object whose translation unit cursor is to be obtained 
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#gaec6e69127920785e74e4a517423f4391
+        Returns translation unit cursor
+*/
+static int parser_getcursor(lua_State *L) 
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        CXCursor cursor = clang_getTranslationUnitCursor(parser->tu);
+        if (clang_Cursor_isNull(cursor)) {
+                lua_pushnil(L);
+        } else {
+                push_cursor(L, cursor);
+        }
+        return 1;
+}
+
+/*      
+        Format - parser:getNumDiagnostics()
+        Parameter - parser - Clang object whose translation unit is to be diagnosed 
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#gae9f047b4bbbbb01161478d549b7aab25
+        Returns the number of diagnostics produced for the given translation unit 
+*/
+static int parser_getnumdiagnostics(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        unsigned int num_diags = clang_getNumDiagnostics(parser->tu);
+        lua_pushinteger(L, num_diags);
+        return 1;
+}
+
+/*      
+        Format - parser:getDiagnostic(idx)
+        Parameters - parser - Clang object whose translation unit is to be diagnosed 
+                   - idx    - Index of the specific diagnostic
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#ga3f54a79e820c2ac9388611e98029afe5
+                  - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#gabfcf70ac15bb3e5ae39ef2c5e07c7428
+                  - https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html#ga01f1a342f7807ea742aedd2c61c46fa0
+                  - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#ga455234ab6de0ca12c9ea36f8874060e8
+        Returns - 1. Line number 
+                  2. Column number
+                  3. Diagnostic message 
+*/
+static int parser_getdiagnostic(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        unsigned int index = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, index <= clang_getNumDiagnostics(parser->tu), 1, "argument index out of bounds");
+        CXDiagnostic diag = clang_getDiagnostic(parser->tu, index-1);
+        CXSourceLocation location = clang_getDiagnosticLocation(diag);
+        unsigned int line, column;
+        clang_getSpellingLocation(location, NULL, &line, &column, NULL);
+        CXString err_str = clang_formatDiagnostic(diag, 0);
+        lua_pushinteger(L, line);
+        lua_pushinteger(L, column);
+        lua_pushstring(L, clang_getCString(err_str));
+        clang_disposeDiagnostic(diag);
+        clang_disposeString(err_str);
+        return 3;  
+}
+
+static const char *const severity_names[] = {"ignored", "note", "warning", "error", "fatal", NULL};
+
+/* Set the fields 'file' (unless NULL), 'line' and 'column' of the table on top of the stack to 'location' */
+static void set_location_fields(lua_State *L, CXSourceLocation location, const char *file_field,
+                                const char *line_field, const char *column_field)
+{
+        CXFile file;
+        unsigned int line, column;
+        clang_getSpellingLocation(location, &file, &line, &column, NULL);
+        if (file != NULL && file_field != NULL) {
+                push_cxstring(L, clang_getFileName(file));
+                lua_setfield(L, -2, file_field);
+        }
+        lua_pushinteger(L, line);
+        lua_setfield(L, -2, line_field);
+        lua_pushinteger(L, column);
+        lua_setfield(L, -2, column_field);
+}
+
+/* Push a table with the fields file, startLine, startColumn, endLine and endColumn of 'range' */
+static void push_range(lua_State *L, CXSourceRange range)
+{
+        lua_createtable(L, 0, 5);
+        set_location_fields(L, clang_getRangeStart(range), "file", "startLine", "startColumn");
+        set_location_fields(L, clang_getRangeEnd(range), NULL, "endLine", "endColumn");
+}
+
+/*
+        Push the description of 'diag', see parser:getDiagnostics(). The table at 'path' locates
+        the diagnostic for the lazy message and text fields : the parser object, the index of
+        the diagnostic, then the index of each nested note, and the number of reparses.
+*/
+static void push_diagnostic(lua_State *L, CXDiagnostic diag, int path)
+{
+        luaL_checkstack(L, 8, NULL);
+        lua_createtable(L, 0, 8);
+        luaL_setmetatable(L, DIAGNOSTIC_METATABLE);
+        lua_getfield(L, LUA_REGISTRYINDEX, DIAGNOSTIC_PATHS);
+        lua_pushvalue(L, -2);
+        lua_pushvalue(L, path);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+        lua_pushstring(L, severity_names[clang_getDiagnosticSeverity(diag)]);
+        lua_setfield(L, -2, "severity");
+        set_location_fields(L, clang_getDiagnosticLocation(diag), "file", "line", "column");
+        if (clang_getDiagnosticCategory(diag) != 0) {
+                push_cxstring(L, clang_getDiagnosticCategoryText(diag));
+                lua_setfield(L, -2, "category");
+        }
+        CXString option = clang_getDiagnosticOption(diag, NULL);
+        if (clang_getCString(option)[0] != '\0') {
+                lua_pushstring(L, clang_getCString(option));
+                lua_setfield(L, -2, "option");
+        }
+        clang_disposeString(option);
+        unsigned num_ranges = clang_getDiagnosticNumRanges(diag);
+        lua_createtable(L, num_ranges, 0);
+        for (unsigned i = 0; i < num_ranges; i++) {
+                push_range(L, clang_getDiagnosticRange(diag, i));
+                lua_rawseti(L, -2, i+1);
+        }
+        lua_setfield(L, -2, "ranges");
+        unsigned num_fixits = clang_getDiagnosticNumFixIts(diag);
+        lua_createtable(L, num_fixits, 0);
+        for (unsigned i = 0; i < num_fixits; i++) {
+                CXSourceRange range;
+                CXString text = clang_getDiagnosticFixIt(diag, i, &range);
+                push_range(L, range);
+                push_cxstring(L, text);
+                lua_setfield(L, -2, "text");
+                lua_rawseti(L, -2, i+1);
+        }
+        lua_setfield(L, -2, "fixits");
+        CXDiagnosticSet children = clang_getChildDiagnostics(diag);       /* owned by 'diag' */
+        unsigned num_notes = clang_getNumDiagnosticsInSet(children);
+        lua_createtable(L, num_notes, 0);
+        int len = lua_rawlen(L, path);
+        for (unsigned i = 0; i < num_notes; i++) {
+                lua_createtable(L, len+1, 1);
+                for (int k = 1; k <= len; k++) {
+                        lua_rawgeti(L, path, k);
+                        lua_rawseti(L, -2, k);
+                }
+                lua_pushinteger(L, i+1);
+                lua_rawseti(L, -2, len+1);
+                lua_getfield(L, path, "reparses");
+                lua_setfield(L, -2, "reparses");
+                push_diagnostic(L, clang_getDiagnosticInSet(children, i), lua_gettop(L));
+                lua_remove(L, -2);
+                lua_rawseti(L, -2, i+1);
+        }
+        lua_setfield(L, -2, "notes");
+}
+
+/*
+        Format - parser:getDiagnostics([options])
+        Parameters - parser - Clang object whose translation unit is to be diagnosed
+                   - options - Optional table with the fields :
+                        1. minSeverity - Least severity of the returned diagnostics, one of "ignored",
+                           "note", "warning", "error" and "fatal", all diagnostics by default
+                        2. limit - Maximum number of returned diagnostics, unlimited by default
+        Diagnostics are filtered before anything else is read from them. Each one is described by
+        a table with the fields severity, file, line, column, category and option (if any), ranges
+        and fixits (tables with the fields file, startLine, startColumn, endLine, endColumn, plus
+        text for fix-its) and notes (nested diagnostics). The fields message (the bare message)
+        and text (formatted as by clang) are only formatted when read, which must happen before
+        the parser is reparsed or disposed.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html
+        Returns an array with the description of each diagnostic
+*/
+static int parser_getdiagnostics(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        int min_severity = CXDiagnostic_Ignored;
+        lua_Integer limit = -1;          /* unlimited */
+        if (!lua_isnoneornil(L, 2)) {
+                luaL_checktype(L, 2, LUA_TTABLE);
+                lua_getfield(L, 2, "minSeverity");
+                if (!lua_isnil(L, -1)) {
+                        const char *name = lua_tostring(L, -1);
+                        for (min_severity = 0; severity_names[min_severity] != NULL; min_severity++) {
+                                if (name != NULL && strcmp(severity_names[min_severity], name) == 0)
+                                        break;
+                        }
+                        luaL_argcheck(L, severity_names[min_severity] != NULL, 2, "unknown minSeverity");
+                }
+                lua_getfield(L, 2, "limit");
+                if (!lua_isnil(L, -1)) {
+                        luaL_argcheck(L, lua_isinteger(L, -1) && lua_tointeger(L, -1) >= 0, 2,
+                                      "expect non-negative integer limit");
+                        limit = lua_tointeger(L, -1);
+                }
+                lua_pop(L, 2);
+        }
+        lua_newtable(L);
+        unsigned num_diags = clang_getNumDiagnostics(parser->tu);
+        lua_Integer count = 0;
+        for (unsigned i = 0; i < num_diags && (limit < 0 || count < limit); i++) {
+                CXDiagnostic diag = clang_getDiagnostic(parser->tu, i);
+                if ((int) clang_getDiagnosticSeverity(diag) >= min_severity) {
+                        lua_createtable(L, 2, 1);
+                        lua_pushvalue(L, 1);
+                        lua_rawseti(L, -2, 1);
+                        lua_pushinteger(L, i+1);
+                        lua_rawseti(L, -2, 2);
+                        lua_pushinteger(L, parser->stats.num_reparses);
+                        lua_setfield(L, -2, "reparses");
+                        push_diagnostic(L, diag, lua_gettop(L));
+                        lua_remove(L, -2);
+                        lua_rawseti(L, -2, ++count);
+                }
+                clang_disposeDiagnostic(diag);
+        }
+        return 1;
+}
+
+/* Format the message or text field of a diagnostic description when it is first read */
+static int diagnostic_index(lua_State *L)
+{
+        const char *key = lua_tostring(L, 2);
+        if (key == NULL || (strcmp(key, "message") != 0 && strcmp(key, "text") != 0))
+                return 0;
+        lua_getfield(L, LUA_REGISTRYINDEX, DIAGNOSTIC_PATHS);
+        lua_pushvalue(L, 1);
+        if (lua_rawget(L, -2) != LUA_TTABLE)
+                return 0;
+        int path = lua_gettop(L);
+        lua_rawgeti(L, path, 1);
+        clang_parser *parser = (clang_parser *) lua_touserdata(L, -1);
+        if (parser->tu == NULL)
+                return luaL_error(L, "parser object was disposed");
+        lua_getfield(L, path, "reparses");
+        if (lua_tointeger(L, -1) != parser->stats.num_reparses)
+                return luaL_error(L, "parser object was reparsed");
+        lua_rawgeti(L, path, 2);
+        CXDiagnostic top = clang_getDiagnostic(parser->tu, lua_tointeger(L, -1) - 1);
+        CXDiagnostic diag = top;
+        int len = lua_rawlen(L, path);
+        for (int k = 3; k <= len; k++) {
+                lua_rawgeti(L, path, k);
+                diag = clang_getDiagnosticInSet(clang_getChildDiagnostics(diag), lua_tointeger(L, -1) - 1);
+                lua_pop(L, 1);
+        }
+        if (key[0] == 't')
+                push_cxstring(L, clang_formatDiagnostic(diag, clang_defaultDiagnosticDisplayOptions()));
+        else
+                push_cxstring(L, clang_getDiagnosticSpelling(diag));
+        clang_disposeDiagnostic(top);
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, -2);
+        lua_rawset(L, 1);
+        return 1;
+}
+
+/*
+        Format - parser:stats()
+        Parameter - parser - Clang object whose resource usage is to be reported
+        The counters are cumulative over the life of the parser, parseTime is the wall-clock
+        time of the last parse, load or reparse.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html
+        Returns a table with the fields :
+                1. parseTime - Seconds spent in the last parse
+                2. numReparses - Number of calls of parser:reparse()
+                3. cursorsVisited - Cursors seen by visitChildren, the cursor iterators and extract
+                4. callbacks - Calls of Lua visitor functions
+                5. objectsAllocated - Cursor and type objects created by the binding
+                6. memory - Table mapping the name of each memory category tracked by libclang
+                   ("AST", "Identifiers", "Selectors", "SourceManager: content cache allocator" ...) to its size in bytes
+                7. memoryTotal - Sum of the memory categories
+                8. usedPCH - Whether the parse included the shared PCH of luaclang.usePCH()
+*/
+static int parser_stats(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        lua_createtable(L, 0, 8);
+        lua_pushnumber(L, parser->stats.parse_time);
+        lua_setfield(L, -2, "parseTime");
+        lua_pushinteger(L, parser->stats.num_reparses);
+        lua_setfield(L, -2, "numReparses");
+        lua_pushinteger(L, (lua_Integer) parser->stats.cursors_visited);
+        lua_setfield(L, -2, "cursorsVisited");
+        lua_pushinteger(L, (lua_Integer) parser->stats.callbacks);
+        lua_setfield(L, -2, "callbacks");
+        lua_pushinteger(L, (lua_Integer) parser->stats.objects);
+        lua_setfield(L, -2, "objectsAllocated");
+        lua_pushboolean(L, parser->stats.used_pch);
+        lua_setfield(L, -2, "usedPCH");
+        CXTUResourceUsage usage = clang_getCXTUResourceUsage(parser->tu);
+        lua_Integer total = 0;
+        lua_createtable(L, 0, usage.numEntries);
+        for (unsigned i = 0; i < usage.numEntries; i++) {
+                lua_pushinteger(L, (lua_Integer) usage.entries[i].amount);
+                lua_setfield(L, -2, clang_getTUResourceUsageName(usage.entries[i].kind));
+                total += (lua_Integer) usage.entries[i].amount;
+        }
+        clang_disposeCXTUResourceUsage(usage);
+        lua_setfield(L, -2, "memory");
+        lua_pushinteger(L, total);
+        lua_setfield(L, -2, "memoryTotal");
+        return 1;
+}
+
+static unsigned intern_type(lua_State *L, clang_parser *parser, int types, CXType type);
+static void push_type_kind(lua_State *L, enum CXTypeKind kind);
+
+/* Set field 'name' of the table on top of the stack to the id of 'type' */
+static void set_type_id(lua_State *L, clang_parser *parser, int types, const char *name, CXType type)
+{
+        lua_pushinteger(L, intern_type(L, parser, types, type));
+        lua_setfield(L, -2, name);
+}
+
+/*
+        Intern the canonical type of 'type' and return its id. The description of a newly interned
+        type is stored at its id in the table at 'types', interning the types it refers to as well.
+*/
+static unsigned intern_type(lua_State *L, clang_parser *parser, int types, CXType type)
+{
+        type = clang_getCanonicalType(type);
+        if (parser->types == NULL) {
+                parser->types = (type_table *) calloc(1, sizeof(type_table));
+                if (parser->types == NULL)
+                        luaL_error(L, "not enough memory");
+        }
+        unsigned id = type_table_find(parser->types, type);
+        if (id != 0)
+                return id;
+        id = type_table_add(parser->types, type);
+        if (id == 0)
+                luaL_error(L, "not enough memory");
+        luaL_checkstack(L, 4, "type nested too deeply");
+        lua_createtable(L, 0, 8);
+        lua_pushinteger(L, id);
+        lua_setfield(L, -2, "id");
+        push_cxstring(L, clang_getTypeSpelling(type));
+        lua_setfield(L, -2, "spelling");
+        push_type_kind(L, type.kind);
+        lua_setfield(L, -2, "kind");
+        lua_pushboolean(L, clang_isConstQualifiedType(type));
+        lua_setfield(L, -2, "isConst");
+        lua_pushboolean(L, clang_isVolatileQualifiedType(type));
+        lua_setfield(L, -2, "isVolatile");
+        lua_pushboolean(L, clang_isRestrictQualifiedType(type));
+        lua_setfield(L, -2, "isRestrict");
+        switch (type.kind) {
+                case CXType_Pointer:
+                        set_type_id(L, parser, types, "pointee", clang_getPointeeType(type));
+                        break;
+                case CXType_ConstantArray:
+                        lua_pushinteger(L, clang_getArraySize(type));
+                        lua_setfield(L, -2, "size");
+                        /* fallthrough */
+                case CXType_IncompleteArray:
+                case CXType_VariableArray:
+                        set_type_id(L, parser, types, "element", clang_getArrayElementType(type));
+                        break;
+                case CXType_FunctionProto: {
+                        int num_args = clang_getNumArgTypes(type);
+                        lua_createtable(L, num_args, 0);
+                        for (int i = 0; i < num_args; i++) {
+                                lua_pushinteger(L, intern_type(L, parser, types, clang_getArgType(type, i)));
+                                lua_rawseti(L, -2, i + 1);
+                        }
+                        lua_setfield(L, -2, "args");
+                        lua_pushboolean(L, clang_isFunctionTypeVariadic(type));
+                        lua_setfield(L, -2, "isVariadic");
+                }
+                        /* fallthrough */
+                case CXType_FunctionNoProto:
+                        set_type_id(L, parser, types, "result", clang_getResultType(type));
+                        break;
+                default:
+                        break;
+        }
+        lua_rawseti(L, types, id);
+        return id;
+}
+
+/*
+        Push the table of the types interned by the parser at 'arg', creating it if needed. The types
+        added by an internType() call which raised an error before describing them are removed.
+*/
+static int push_type_infos(lua_State *L, int arg)
+{
+        clang_parser *parser = (clang_parser *) lua_touserdata(L, arg);
+        lua_getuservalue(L, arg);
+        if (lua_getfield(L, -1, "types") == LUA_TNIL) {
+                lua_pop(L, 1);
+                lua_newtable(L);
+                lua_pushvalue(L, -1);
+                lua_setfield(L, -3, "types");
+        }
+        lua_remove(L, -2);
+        type_table *table = parser->types;
+        if (table != NULL && table->committed < table->count) {
+                for (unsigned id = table->committed + 1; id <= table->count; id++) {
+                        lua_pushnil(L);
+                        lua_rawseti(L, -2, id);
+                }
+                type_table_truncate(table, table->committed);
+        }
+        return lua_gettop(L);
+}
+
+/*
+        Format - parser:internType(cur_type)
+        Parameters - parser - Clang object whose translation unit the type belongs to
+                   - cur_type - Type to be interned
+        Canonical types are interned, so typedefs resolve to the type they name and equal
+        types get the same id. Ids stay valid until the parser is reparsed or disposed.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+        Returns the integer id of the canonical type
+*/
+static int parser_interntype(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 2);
+        luaL_argcheck(L, type->data[1] == parser->tu, 2, "type belongs to another translation unit");
+        int types = push_type_infos(L, 1);
+        lua_pushinteger(L, intern_type(L, parser, types, *type));
+        parser->types->committed = parser->types->count;
+        return 1;
+}
+
+/*
+        Format - parser:getTypeInfo(id)
+        Parameters - parser - Clang object which interned the type
+                   - id - Id returned by parser:internType()
+        The description is a table with the fields id, spelling, kind, isConst, isVolatile and isRestrict, plus :
+                - Pointer - pointee
+                - ConstantArray, IncompleteArray, VariableArray - element, and size for ConstantArray
+                - FunctionProto, FunctionNoProto - result, and args and isVariadic for FunctionProto
+        where pointee, element, result and args hold the ids of the types referred to.
+        Returns the description of the type, the same table on every call
+*/
+static int parser_gettypeinfo(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        lua_Integer id = luaL_checkinteger(L, 2);
+        int types = push_type_infos(L, 1);
+        unsigned count = parser->types != NULL ? parser->types->count : 0;
+        luaL_argcheck(L, id >= 1 && id <= count, 2, "unknown type id");
+        lua_rawgeti(L, types, id);
+        return 1;
+}
+
+/*
+        Format - parser:getTypes()
+        Parameter - parser - Clang object whose interned types are to be obtained
+        Returns an array with the description of every interned type, indexed by id, see parser:getTypeInfo()
+*/
+static int parser_gettypes(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        push_type_infos(L, 1);
+        return 1;
+}
+
+/* --Cursor functions-- */
+
+/*      
+        Format - cur:getSpelling()
+        Parameter - cur - Cursor whose name is to be obtained    
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html#gaad1c9b2a1c5ef96cebdbc62f1671c763
+	Returns the name(spelling) of the entity represented by the cursor
+*/
+static int cursor_getspelling(lua_State *L) 
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        CXString name = clang_getCursorSpelling(*cur);
+        lua_pushstring(L, clang_getCString(name));
+        clang_disposeString(name);
+        return 1;
+}
+
+/*
+        Format - cur:getUSR()
+        Parameter - cur - Cursor whose Unified Symbol Resolution is to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html
+        Returns the USR of the entity represented by the cursor, an empty string if it has none
+*/
+static int cursor_getusr(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        push_cxstring(L, clang_getCursorUSR(*cur));
+        return 1;
+}
+
+/*
+        Names of every CXCursorKind and CXTypeKind, indexed by kind. Generated from clang-c/Index.h of
+        LLVM 18, the names are the enumerators without their CXCursor_ or CXType_ prefix. The kinds are
+        written as numbers so that the tables also build against older headers, which lack some of them.
+*/
+static const char *const cursor_kind_names[] = {
+        [1] = "UnexposedDecl",
+        [2] = "StructDecl",
+        [3] = "UnionDecl",
+        [4] = "ClassDecl",
+        [5] = "EnumDecl",
+        [6] = "FieldDecl",
+        [7] = "EnumConstantDecl",
+        [8] = "FunctionDecl",
+        [9] = "VarDecl",
+        [10] = "ParmDecl",
+        [11] = "ObjCInterfaceDecl",
+        [12] = "ObjCCategoryDecl",
+        [13] = "ObjCProtocolDecl",
+        [14] = "ObjCPropertyDecl",
+        [15] = "ObjCIvarDecl",
+        [16] = "ObjCInstanceMethodDecl",
+        [17] = "ObjCClassMethodDecl",
+        [18] = "ObjCImplementationDecl",
+        [19] = "ObjCCategoryImplDecl",
+        [20] = "TypedefDecl",
+        [21] = "CXXMethod",
+        [22] = "Namespace",
+        [23] = "LinkageSpec",
+        [24] = "Constructor",
+        [25] = "Destructor",
+        [26] = "ConversionFunction",
+        [27] = "TemplateTypeParameter",
+        [28] = "NonTypeTemplateParameter",
+        [29] = "TemplateTemplateParameter",
+        [30] = "FunctionTemplate",
+        [31] = "ClassTemplate",
+        [32] = "ClassTemplatePartialSpecialization",
+        [33] = "NamespaceAlias",
+        [34] = "UsingDirective",
+        [35] = "UsingDeclaration",
+        [36] = "TypeAliasDecl",
+        [37] = "ObjCSynthesizeDecl",
+        [38] = "ObjCDynamicDecl",
+        [39] = "CXXAccessSpecifier",
+        [40] = "ObjCSuperClassRef",
+        [41] = "ObjCProtocolRef",
+        [42] = "ObjCClassRef",
+        [43] = "TypeRef",
+        [44] = "CXXBaseSpecifier",
+        [45] = "TemplateRef",
+        [46] = "NamespaceRef",
+        [47] = "MemberRef",
+        [48] = "LabelRef",
+        [49] = "OverloadedDeclRef",
+        [50] = "VariableRef",
+        [70] = "InvalidFile",
+        [71] = "NoDeclFound",
+        [72] = "NotImplemented",
+        [73] = "InvalidCode",
+        [100] = "UnexposedExpr",
+        [101] = "DeclRefExpr",
+        [102] = "MemberRefExpr",
+        [103] = "CallExpr",
+        [104] = "ObjCMessageExpr",
+        [105] = "BlockExpr",
+        [106] = "IntegerLiteral",
+        [107] = "FloatingLiteral",
+        [108] = "ImaginaryLiteral",
+        [109] = "StringLiteral",
+        [110] = "CharacterLiteral",
+        [111] = "ParenExpr",
+        [112] = "UnaryOperator",
+        [113] = "ArraySubscriptExpr",
+        [114] = "BinaryOperator",
+        [115] = "CompoundAssignOperator",
+        [116] = "ConditionalOperator",
+        [117] = "CStyleCastExpr",
+        [118] = "CompoundLiteralExpr",
+        [119] = "InitListExpr",
+        [120] = "AddrLabelExpr",
+        [121] = "StmtExpr",
+        [122] = "GenericSelectionExpr",
+        [123] = "GNUNullExpr",
+        [124] = "CXXStaticCastExpr",
+        [125] = "CXXDynamicCastExpr",
+        [126] = "CXXReinterpretCastExpr",
+        [127] = "CXXConstCastExpr",
+        [128] = "CXXFunctionalCastExpr",
+        [129] = "CXXTypeidExpr",
+        [130] = "CXXBoolLiteralExpr",
+        [131] = "CXXNullPtrLiteralExpr",
+        [132] = "CXXThisExpr",
+        [133] = "CXXThrowExpr",
+        [134] = "CXXNewExpr",
+        [135] = "CXXDeleteExpr",
+        [136] = "UnaryExpr",
+        [137] = "ObjCStringLiteral",
+        [138] = "ObjCEncodeExpr",
+        [139] = "ObjCSelectorExpr",
+        [140] = "ObjCProtocolExpr",
+        [141] = "ObjCBridgedCastExpr",
+        [142] = "PackExpansionExpr",
+        [143] = "SizeOfPackExpr",
+        [144] = "LambdaExpr",
+        [145] = "ObjCBoolLiteralExpr",
+        [146] = "ObjCSelfExpr",
+        [147] = "OMPArraySectionExpr",
+        [148] = "ObjCAvailabilityCheckExpr",
+        [149] = "FixedPointLiteral",
+        [150] = "OMPArrayShapingExpr",
+        [151] = "OMPIteratorExpr",
+        [152] = "CXXAddrspaceCastExpr",
+        [153] = "ConceptSpecializationExpr",
+        [154] = "RequiresExpr",
+        [155] = "CXXParenListInitExpr",
+        [200] = "UnexposedStmt",
+        [201] = "LabelStmt",
+        [202] = "CompoundStmt",
+        [203] = "CaseStmt",
+        [204] = "DefaultStmt",
+        [205] = "IfStmt",
+        [206] = "SwitchStmt",
+        [207] = "WhileStmt",
+        [208] = "DoStmt",
+        [209] = "ForStmt",
+        [210] = "GotoStmt",
+        [211] = "IndirectGotoStmt",
+        [212] = "ContinueStmt",
+        [213] = "BreakStmt",
+        [214] = "ReturnStmt",
+        [215] = "GCCAsmStmt",
+        [216] = "ObjCAtTryStmt",
+        [217] = "ObjCAtCatchStmt",
+        [218] = "ObjCAtFinallyStmt",
+        [219] = "ObjCAtThrowStmt",
+        [220] = "ObjCAtSynchronizedStmt",
+        [221] = "ObjCAutoreleasePoolStmt",
+        [222] = "ObjCForCollectionStmt",
+        [223] = "CXXCatchStmt",
+        [224] = "CXXTryStmt",
+        [225] = "CXXForRangeStmt",
+        [226] = "SEHTryStmt",
+        [227] = "SEHExceptStmt",
+        [228] = "SEHFinallyStmt",
+        [229] = "MSAsmStmt",
+        [230] = "NullStmt",
+        [231] = "DeclStmt",
+        [232] = "OMPParallelDirective",
+        [233] = "OMPSimdDirective",
+        [234] = "OMPForDirective",
+        [235] = "OMPSectionsDirective",
+        [236] = "OMPSectionDirective",
+        [237] = "OMPSingleDirective",
+        [238] = "OMPParallelForDirective",
+        [239] = "OMPParallelSectionsDirective",
+        [240] = "OMPTaskDirective",
+        [241] = "OMPMasterDirective",
+        [242] = "OMPCriticalDirective",
+        [243] = "OMPTaskyieldDirective",
+        [244] = "OMPBarrierDirective",
+        [245] = "OMPTaskwaitDirective",
+        [246] = "OMPFlushDirective",
+        [247] = "SEHLeaveStmt",
+        [248] = "OMPOrderedDirective",
+        [249] = "OMPAtomicDirective",
+        [250] = "OMPForSimdDirective",
+        [251] = "OMPParallelForSimdDirective",
+        [252] = "OMPTargetDirective",
+        [253] = "OMPTeamsDirective",
+        [254] = "OMPTaskgroupDirective",
+        [255] = "OMPCancellationPointDirective",
+        [256] = "OMPCancelDirective",
+        [257] = "OMPTargetDataDirective",
+        [258] = "OMPTaskLoopDirective",
+        [259] = "OMPTaskLoopSimdDirective",
+        [260] = "OMPDistributeDirective",
+        [261] = "OMPTargetEnterDataDirective",
+        [262] = "OMPTargetExitDataDirective",
+        [263] = "OMPTargetParallelDirective",
+        [264] = "OMPTargetParallelForDirective",
+        [265] = "OMPTargetUpdateDirective",
+        [266] = "OMPDistributeParallelForDirective",
+        [267] = "OMPDistributeParallelForSimdDirective",
+        [268] = "OMPDistributeSimdDirective",
+        [269] = "OMPTargetParallelForSimdDirective",
+        [270] = "OMPTargetSimdDirective",
+        [271] = "OMPTeamsDistributeDirective",
+        [272] = "OMPTeamsDistributeSimdDirective",
+        [273] = "OMPTeamsDistributeParallelForSimdDirective",
+        [274] = "OMPTeamsDistributeParallelForDirective",
+        [275] = "OMPTargetTeamsDirective",
+        [276] = "OMPTargetTeamsDistributeDirective",
+        [277] = "OMPTargetTeamsDistributeParallelForDirective",
+        [278] = "OMPTargetTeamsDistributeParallelForSimdDirective",
+        [279] = "OMPTargetTeamsDistributeSimdDirective",
+        [280] = "BuiltinBitCastExpr",
+        [281] = "OMPMasterTaskLoopDirective",
+        [282] = "OMPParallelMasterTaskLoopDirective",
+        [283] = "OMPMasterTaskLoopSimdDirective",
+        [284] = "OMPParallelMasterTaskLoopSimdDirective",
+        [285] = "OMPParallelMasterDirective",
+        [286] = "OMPDepobjDirective",
+        [287] = "OMPScanDirective",
+        [288] = "OMPTileDirective",
+        [289] = "OMPCanonicalLoop",
+        [290] = "OMPInteropDirective",
+        [291] = "OMPDispatchDirective",
+        [292] = "OMPMaskedDirective",
+        [293] = "OMPUnrollDirective",
+        [294] = "OMPMetaDirective",
+        [295] = "OMPGenericLoopDirective",
+        [296] = "OMPTeamsGenericLoopDirective",
+        [297] = "OMPTargetTeamsGenericLoopDirective",
+        [298] = "OMPParallelGenericLoopDirective",
+        [299] = "OMPTargetParallelGenericLoopDirective",
+        [300] = "OMPParallelMaskedDirective",
+        [301] = "OMPMaskedTaskLoopDirective",
+        [302] = "OMPMaskedTaskLoopSimdDirective",
+        [303] = "OMPParallelMaskedTaskLoopDirective",
+        [304] = "OMPParallelMaskedTaskLoopSimdDirective",
+        [305] = "OMPErrorDirective",
+        [306] = "OMPScopeDirective",
+        [350] = "TranslationUnit",
+        [400] = "UnexposedAttr",
+        [401] = "IBActionAttr",
+        [402] = "IBOutletAttr",
+        [403] = "IBOutletCollectionAttr",
+        [404] = "CXXFinalAttr",
+        [405] = "CXXOverrideAttr",
+        [406] = "AnnotateAttr",
+        [407] = "AsmLabelAttr",
+        [408] = "PackedAttr",
+        [409] = "PureAttr",
+        [410] = "ConstAttr",
+        [411] = "NoDuplicateAttr",
+        [412] = "CUDAConstantAttr",
+        [413] = "CUDADeviceAttr",
+        [414] = "CUDAGlobalAttr",
+        [415] = "CUDAHostAttr",
+        [416] = "CUDASharedAttr",
+        [417] = "VisibilityAttr",
+        [418] = "DLLExport",
+        [419] = "DLLImport",
+        [420] = "NSReturnsRetained",
+        [421] = "NSReturnsNotRetained",
+        [422] = "NSReturnsAutoreleased",
+        [423] = "NSConsumesSelf",
+        [424] = "NSConsumed",
+        [425] = "ObjCException",
+        [426] = "ObjCNSObject",
+        [427] = "ObjCIndependentClass",
+        [428] = "ObjCPreciseLifetime",
+        [429] = "ObjCReturnsInnerPointer",
+        [430] = "ObjCRequiresSuper",
+        [431] = "ObjCRootClass",
+        [432] = "ObjCSubclassingRestricted",
+        [433] = "ObjCExplicitProtocolImpl",
+        [434] = "ObjCDesignatedInitializer",
+        [435] = "ObjCRuntimeVisible",
+        [436] = "ObjCBoxable",
+        [437] = "FlagEnum",
+        [438] = "ConvergentAttr",
+        [439] = "WarnUnusedAttr",
+        [440] = "WarnUnusedResultAttr",
+        [441] = "AlignedAttr",
+        [500] = "PreprocessingDirective",
+        [501] = "MacroDefinition",
+        [502] = "MacroExpansion",
+        [503] = "InclusionDirective",
+        [600] = "ModuleImportDecl",
+        [601] = "TypeAliasTemplateDecl",
+        [602] = "StaticAssert",
+        [603] = "FriendDecl",
+        [604] = "ConceptDecl",
+        [700] = "OverloadCandidate",
+};
+
+static const char *const type_kind_names[] = {
+        [0] = "Invalid",
+        [1] = "Unexposed",
+        [2] = "Void",
+        [3] = "Bool",
+        [4] = "Char_U",
+        [5] = "UChar",
+        [6] = "Char16",
+        [7] = "Char32",
+        [8] = "UShort",
+        [9] = "UInt",
+        [10] = "ULong",
+        [11] = "ULongLong",
+        [12] = "UInt128",
+        [13] = "Char_S",
+        [14] = "SChar",
+        [15] = "WChar",
+        [16] = "Short",
+        [17] = "Int",
+        [18] = "Long",
+        [19] = "LongLong",
+        [20] = "Int128",
+        [21] = "Float",
+        [22] = "Double",
+        [23] = "LongDouble",
+        [24] = "NullPtr",
+        [25] = "Overload",
+        [26] = "Dependent",
+        [27] = "ObjCId",
+        [28] = "ObjCClass",
+        [29] = "ObjCSel",
+        [30] = "Float128",
+        [31] = "Half",
+        [32] = "Float16",
+        [33] = "ShortAccum",
+        [34] = "Accum",
+        [35] = "LongAccum",
+        [36] = "UShortAccum",
+        [37] = "UAccum",
+        [38] = "ULongAccum",
+        [39] = "BFloat16",
+        [40] = "Ibm128",
+        [100] = "Complex",
+        [101] = "Pointer",
+        [102] = "BlockPointer",
+        [103] = "LValueReference",
+        [104] = "RValueReference",
+        [105] = "Record",
+        [106] = "Enum",
+        [107] = "Typedef",
+        [108] = "ObjCInterface",
+        [109] = "ObjCObjectPointer",
+        [110] = "FunctionNoProto",
+        [111] = "FunctionProto",
+        [112] = "ConstantArray",
+        [113] = "Vector",
+        [114] = "IncompleteArray",
+        [115] = "VariableArray",
+        [116] = "DependentSizedArray",
+        [117] = "MemberPointer",
+        [118] = "Auto",
+        [119] = "Elaborated",
+        [120] = "Pipe",
+        [121] = "OCLImage1dRO",
+        [122] = "OCLImage1dArrayRO",
+        [123] = "OCLImage1dBufferRO",
+        [124] = "OCLImage2dRO",
+        [125] = "OCLImage2dArrayRO",
+        [126] = "OCLImage2dDepthRO",
+        [127] = "OCLImage2dArrayDepthRO",
+        [128] = "OCLImage2dMSAARO",
+        [129] = "OCLImage2dArrayMSAARO",
+        [130] = "OCLImage2dMSAADepthRO",
+        [131] = "OCLImage2dArrayMSAADepthRO",
+        [132] = "OCLImage3dRO",
+        [133] = "OCLImage1dWO",
+        [134] = "OCLImage1dArrayWO",
+        [135] = "OCLImage1dBufferWO",
+        [136] = "OCLImage2dWO",
+        [137] = "OCLImage2dArrayWO",
+        [138] = "OCLImage2dDepthWO",
+        [139] = "OCLImage2dArrayDepthWO",
+        [140] = "OCLImage2dMSAAWO",
+        [141] = "OCLImage2dArrayMSAAWO",
+        [142] = "OCLImage2dMSAADepthWO",
+        [143] = "OCLImage2dArrayMSAADepthWO",
+        [144] = "OCLImage3dWO",
+        [145] = "OCLImage1dRW",
+        [146] = "OCLImage1dArrayRW",
+        [147] = "OCLImage1dBufferRW",
+        [148] = "OCLImage2dRW",
+        [149] = "OCLImage2dArrayRW",
+        [150] = "OCLImage2dDepthRW",
+        [151] = "OCLImage2dArrayDepthRW",
+        [152] = "OCLImage2dMSAARW",
+        [153] = "OCLImage2dArrayMSAARW",
+        [154] = "OCLImage2dMSAADepthRW",
+        [155] = "OCLImage2dArrayMSAADepthRW",
+        [156] = "OCLImage3dRW",
+        [157] = "OCLSampler",
+        [158] = "OCLEvent",
+        [159] = "OCLQueue",
+        [160] = "OCLReserveID",
+        [161] = "ObjCObject",
+        [162] = "ObjCTypeParam",
+        [163] = "Attributed",
+        [164] = "OCLIntelSubgroupAVCMcePayload",
+        [165] = "OCLIntelSubgroupAVCImePayload",
+        [166] = "OCLIntelSubgroupAVCRefPayload",
+        [167] = "OCLIntelSubgroupAVCSicPayload",
+        [168] = "OCLIntelSubgroupAVCMceResult",
+        [169] = "OCLIntelSubgroupAVCImeResult",
+        [170] = "OCLIntelSubgroupAVCRefResult",
+        [171] = "OCLIntelSubgroupAVCSicResult",
+        [172] = "OCLIntelSubgroupAVCImeResultSingleReferenceStreamout",
+        [173] = "OCLIntelSubgroupAVCImeResultDualReferenceStreamout",
+        [174] = "OCLIntelSubgroupAVCImeSingleReferenceStreamin",
+        [175] = "OCLIntelSubgroupAVCImeDualReferenceStreamin",
+        [176] = "ExtVector",
+        [177] = "Atomic",
+        [178] = "BTFTagAttributed",
+};
+
+#define NUM_CURSOR_KINDS (sizeof(cursor_kind_names) / sizeof(cursor_kind_names[0]))
+#define NUM_TYPE_KINDS (sizeof(type_kind_names) / sizeof(type_kind_names[0]))
+
+/* Return the cursor kind as a string */
+static const char *cursor_kind_str(enum CXCursorKind kind) 
+{
+        if ((unsigned) kind < NUM_CURSOR_KINDS && cursor_kind_names[kind] != NULL)
+                return cursor_kind_names[kind];
+        return "Unaddressed";
+}
+
+/* Push the name of the type kind, as spelled by libclang for the kinds newer than type_kind_names */
+static void push_type_kind(lua_State *L, enum CXTypeKind kind)
+{
+        if ((unsigned) kind < NUM_TYPE_KINDS && type_kind_names[kind] != NULL)
+                lua_pushstring(L, type_kind_names[kind]);
+        else
+                push_cxstring(L, clang_getTypeKindSpelling(kind));
+}
+
+/* Return the cursor kind with the given name, or -1 if there is none, see CURSOR_KIND_IDS */
+static int cursor_kind_id(lua_State *L, const char *name)
+{
+        lua_getfield(L, LUA_REGISTRYINDEX, CURSOR_KIND_IDS);
+        lua_getfield(L, -1, name);
+        int kind = lua_isinteger(L, -1) ? (int) lua_tointeger(L, -1) : -1;
+        lua_pop(L, 2);
+        return kind;
+}
+
+/*
+        Read the optional cursor kind at stack position 'arg', either a name as returned by cur:getKind() or
+        an id as returned by cur:getKindId(). Returns -1 if it is absent, and -2 if no cursor has that kind.
+*/
+static int opt_cursor_kind(lua_State *L, int arg)
+{
+        if (lua_isnoneornil(L, arg))
+                return -1;
+        if (lua_type(L, arg) == LUA_TNUMBER) {
+                lua_Integer kind = luaL_checkinteger(L, arg);
+                return kind >= 0 && kind <= INT_MAX ? (int) kind : -2;
+        }
+        int kind = cursor_kind_id(L, luaL_checkstring(L, arg));
+        return kind < 0 ? -2 : kind;
+}
+
+/*      
+        Format - cur:getKind()
+        Parameter - cur - Cursor whose kind is to be obtained    
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga018aaf60362cb751e517d9f8620d490c
+*/
+static int cursor_getkind(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        lua_pushstring(L, cursor_kind_str(clang_getCursorKind(*cur)));
+        return 1;
+}
+
+/*
+        Format - cur:getKindId()
+        Parameter - cur - Cursor whose kind is to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga018aaf60362cb751e517d9f8620d490c
+        Returns the kind as the integer value of the CXCursorKind, see luaclang.cursorKinds
+*/
+static int cursor_getkindid(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        lua_pushinteger(L, clang_getCursorKind(*cur));
+        return 1;
+}
+
+/*
+        Format - cur:getType()
+        Parameter - cur - Cursor whose type is to be obtained    
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#gaae5702661bb1f2f93038051737de20f4
+        Returns the type of the cursor
+*/
+static int cursor_gettype(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        push_type(L, clang_getCursorType(*cur));
+        return 1;
+}
+
+/*      
+        Format - cur:getNumArgs()
+        Parameter - cur - Cursor which represents a function
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga5254f761b57fd78de3ac9c6bfcaa7fed
+        Returns the number of non-variadic arguments in the function is to be obtained
+*/
+static int cursor_getnumargs(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FunctionDecl, 1, "expect cursor with function kind");
+        int num_args = clang_Cursor_getNumArguments(*cur);
+        lua_pushnumber(L, num_args);
+        return 1;
+}
+
+/*
+        Format - cur:getArgCursor(idx)
+        Parameters - cur - Cursor representing the function declaration 
+                   - idx - parameter index (starting from 1)
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga673c5529d33eedd0b78aca5ac6fc1d7c
+        Returns the cursor of the parameter at index 'idx' in the function 
+*/
+static int cursor_getarg(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FunctionDecl, 1, "expect cursor with function kind");
+        unsigned int index = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, index <= clang_Cursor_getNumArguments(*cur), 1, "argument index out of bounds");
+        push_cursor(L, clang_Cursor_getArgument(*cur, index-1));
+        return 1;
+}
+
+/*      
+        Format - cur:isFunctionInline()
+        Parameter - cur - Cursor which is to be checked (whether the FunctionDecl 'cur' represents is inline)
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga5254f761b57fd78de3ac9c6bfcaa7fed
+        Returns 'true' if the function is inlined , 'false' otherwise
+*/
+static int cursor_isinlined(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FunctionDecl, 1, "expect cursor with function kind");
+        CINDEX_LINKAGE bool is_inline;
+        is_inline = clang_Cursor_isFunctionInlined(*cur);
+        lua_pushboolean(L, is_inline);
+        return 1;
+}
+
+/*      
+        Format - cur:getEnumValue()
+        Parameter - cur - Cursor which represents an EnumConstantDecl whose integer value is to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga6b8585818420e7512feb4c9d209b4f4d
+        Returns the integer value corresponding to the EnumConstantDecl
+*/
+static int cursor_getenumvalue(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_EnumConstantDecl, 1, "expect cursor with enum constant kind");
+        int enum_value = clang_getEnumConstantDeclValue(*cur);
+        lua_pushinteger(L, enum_value);
+        return 1;
+}
+
+/* Retrieve the storage class specifier string */
+static const char *storage_class_str(enum CX_StorageClass sc_specifier) 
+{
+        switch (sc_specifier) {
+                case CX_SC_Invalid:
+                        return "invalid";
+                case CX_SC_None:
+                        return "none";
+                case CX_SC_Extern:
+                        return "extern";
+                case CX_SC_Static:
+                        return "static";
+                case CX_SC_PrivateExtern:
+                        return "private extern";
+                case CX_SC_OpenCLWorkGroupLocal:
+                        return "opencl workgroup local";
+                case CX_SC_Auto:
+                        return "auto";
+                case CX_SC_Register:
+                        return "register";
+                default:
+                        return NULL;
+        }
+}
+
+/*
+        Format - cur:getStorageClass()
+        Parameter - cur -Cursor whose storage class specifier is to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga230c7904f3878469d772f3e464b9c83d
+        Returns the storage class specifier string
+*/
+static int cursor_getstorageclass(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        enum CX_StorageClass sc_specifier = clang_Cursor_getStorageClass(*cur);
+        const char *sc_specifier_str = storage_class_str(sc_specifier);
+        if(sc_specifier_str == NULL)
+                luaL_error(L, "lua-clang: %s: unknown case %d", __func__, sc_specifier);
+        else
+                lua_pushstring(L, storage_class_str(sc_specifier));
+        return 1;
+}
+
+/*
+        Format - cur:isBitField()
+        Parameter - cur -Cursor to be checked
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga750705f6b418b25ca00495b7392c740d
+        Returns 'true if the cursor represents a bitfield; 'false' otherwise
+*/
+static int cursor_isbitfield(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FieldDecl, 1, "expect cursor with struct/union field kind");
+        bool is_bitfield = clang_Cursor_isBitField(*cur);
+        lua_pushboolean(L, is_bitfield);
+        return 1;
+}
+
+/*
+        Format - cur:getBitFieldWidth()
+        Parameter - cur - Cursor which represents the bitfield
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga80bbb872dde5b2f26964081338108f91
+        Returns the bit width of a bit field declaration as an integer
+*/
+static int cursor_getbitfield_width(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_Cursor_isBitField(*cur), 1, "expect cursor with struct/union field kind that is a bit field");
+        int bitfield_width = clang_getFieldDeclBitWidth(*cur);
+        lua_pushinteger(L, bitfield_width);
+        return 1;
+}
+
+/*
+        Format - cur:getTypedefUnderlyingType()
+        Parameter - cur - Cursor which represents the TypedefDecl
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga8de899fc18dc859b6fe3b97309f4fd52
+        Returns the Underlying type of a TypedefDecl
+*/
+static int cursor_gettypdef_underlying(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_TypedefDecl, 1, "expect cursor with typedef kind");
+        push_type(L, clang_getTypedefDeclUnderlyingType(*cur));
+        return 1;
+}
+
+/*
+        Format - cur1:equals(cur2)
+        Parameters - cur1 - First cursor
+                   - cur2 - Second cursor
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga98df58f09878710b983b6f3f60f0cba3
+        Returns a boolean value after comparing the two cursors for equality
+*/
+static int cursor_equals(lua_State *L)
+{
+       CXCursor *cur1;
+       to_object(L, cur1, CURSOR_METATABLE, 1); 
+       CXCursor *cur2;
+       to_object(L, cur2, CURSOR_METATABLE, 2);
+       bool is_equal = clang_equalCursors(*cur1, *cur2);
+       lua_pushboolean(L, is_equal);
+       return 1;
+}
+
+/* __eq metamethod, comparing a cursor with any other object */
+static int cursor_eq(lua_State *L)
+{
+        CXCursor *cur1 = (CXCursor *) luaL_testudata(L, 1, CURSOR_METATABLE);
+        CXCursor *cur2 = (CXCursor *) luaL_testudata(L, 2, CURSOR_METATABLE);
+        lua_pushboolean(L, cur1 != NULL && cur2 != NULL && clang_equalCursors(*cur1, *cur2));
+        return 1;
+}
+
+/*
+        Format - cur:hash()
+        Parameter - cur - Cursor to be hashed
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html
+        Returns an integer, equal for equal cursors
+*/
+static int cursor_hash(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        lua_pushinteger(L, clang_hashCursor(*cur));
+        return 1;
+}
+
+/* Return the description of a CXTypeLayoutError */
+static const char *layout_error_str(long long err)
+{
+        switch (err) {
+                case CXTypeLayoutError_Incomplete:
+                        return "type is incomplete";
+                case CXTypeLayoutError_Dependent:
+                        return "type is dependent";
+                case CXTypeLayoutError_NotConstantSize:
+                        return "type doesn't have a constant size";
+                case CXTypeLayoutError_InvalidFieldName:
+                        return "no field of that name";
+                case CXTypeLayoutError_Undeduced:
+                        return "type is undeduced";
+                default:
+                        return "type has no layout";
+        }
+}
+
+/*
+        Format - cur:getFieldOffset()
+        Parameter - cur - Cursor of kind FieldDecl
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+        Returns the offset of the field in bits from the start of its record
+*/
+static int cursor_getfieldoffset(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FieldDecl, 1, "expect cursor with field kind");
+        long long offset = clang_Cursor_getOffsetOfField(*cur);
+        luaL_argcheck(L, offset >= 0, 1, layout_error_str(offset));
+        lua_pushinteger(L, offset);
+        return 1;
+}
+
+/*
+        Format - cur:clone()
+        Parameter - cur - Cursor to be copied, eg. a cursor reused by cur:visitChildren{reuseCursors = true}
+        Returns the cursor object representing the same entity, which unlike a reused cursor stays valid
+*/
+static int cursor_clone(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        push_cursor(L, *cur);
+        return 1;
+}
+
+/*
+        Format - cur:getCursorDefinition()
+        Parameter - cur - Cursor
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html#gafcfbec461e561bf13f1e8540bbbd655b
+        Returns the cursor that describes the definition of cur
+*/
+static int cursor_getcursor_definition(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        push_cursor(L, clang_getCursorDefinition(*cur));
+        return 1;
+}
+
+/* Set of cursor kinds, used to filter cursors in C */
+#define KIND_SET_SIZE 1024
+
+typedef struct kind_set {
+        bool all;       /* no filter was given */
+        unsigned char bits[KIND_SET_SIZE / 8];
+} kind_set;
+
+static bool kind_set_has(const kind_set *set, enum CXCursorKind kind)
+{
+        if (set->all)
+                return true;
+        return kind < KIND_SET_SIZE && (set->bits[kind / 8] & (1 << (kind % 8)));
+}
+
+/* Read the array of cursor kind names or ids at stack position 'list' (or nil) into 'set' */
+static void check_kind_set(lua_State *L, int arg, int list, kind_set *set)
+{
+        memset(set, 0, sizeof(*set));
+        if (lua_isnil(L, list)) {
+                set->all = true;
+                return;
+        }
+        luaL_argcheck(L, lua_istable(L, list), arg, "expect a table of cursor kinds");
+        int num_kinds = luaL_len(L, list);
+        for (int i = 1; i <= num_kinds; i++) {
+                lua_rawgeti(L, list, i);
+                int kind = -1;
+                if (lua_isinteger(L, -1))
+                        kind = lua_tointeger(L, -1) < KIND_SET_SIZE ? lua_tointeger(L, -1) : -1;
+                else if (lua_type(L, -1) == LUA_TSTRING)
+                        kind = cursor_kind_id(L, lua_tostring(L, -1));
+                luaL_argcheck(L, kind >= 0, arg, "unknown cursor kind");
+                set->bits[kind / 8] |= 1 << (kind % 8);
+                lua_pop(L, 1);
+        }
+}
+
+/* Filter applied to cursors in C, before any Lua code runs */
+typedef struct cursor_filter {
+        kind_set kinds;
+        bool main_file_only;
+        bool skip_system_headers;
+        CXFile *files;          /* allowed files, NULL if any file is allowed */
+        int num_files;
+} cursor_filter;
+
+/*
+        Read the filter options of the table at 'arg' :
+                1. kinds - Array of cursor kinds (as returned by cur:getKind())
+                2. mainFileOnly - Only accept cursors located in the main file
+                3. skipSystemHeaders - Reject cursors located in system headers
+                4. files - Array of file names the cursors have to be located in
+        File names are resolved in the translation unit 'tu'; the array of files is malloc'ed.
+*/
+static void check_cursor_filter(lua_State *L, int arg, CXTranslationUnit tu, cursor_filter *filter)
+{
+        lua_getfield(L, arg, "kinds");
+        check_kind_set(L, arg, lua_gettop(L), &filter->kinds);
+        lua_pop(L, 1);
+        filter->main_file_only = opt_boolean(L, arg, "mainFileOnly", false);
+        filter->skip_system_headers = opt_boolean(L, arg, "skipSystemHeaders", false);
+        filter->files = NULL;
+        filter->num_files = 0;
+        lua_getfield(L, arg, "files");
+        if (!lua_isnil(L, -1)) {
+                luaL_argcheck(L, lua_istable(L, -1), arg, "expect a table of file names");
+                int num_files = luaL_len(L, -1);
+                for (int i = 1; i <= num_files; i++) {
+                        lua_rawgeti(L, -1, i);
+                        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, arg, "expect string file names");
+                        lua_pop(L, 1);
+                }
+                filter->files = (CXFile *) malloc((num_files + 1) * sizeof(CXFile));
+                if (filter->files == NULL)
+                        luaL_error(L, "not enough memory");
+                for (int i = 1; i <= num_files; i++) {
+                        lua_rawgeti(L, -1, i);
+                        filter->files[i-1] = clang_getFile(tu, lua_tostring(L, -1));
+                        lua_pop(L, 1);
+                }
+                filter->num_files = num_files;
+        }
+        lua_pop(L, 1);
+}
+
+/* Check whether 'cursor' passes the location filters : mainFileOnly, skipSystemHeaders and files */
+static bool filter_accepts_location(const cursor_filter *filter, CXCursor cursor)
+{
+        if (!filter->main_file_only && !filter->skip_system_headers && filter->files == NULL)
+                return true;
+        CXSourceLocation location = clang_getCursorLocation(cursor);
+        if (filter->main_file_only && !clang_Location_isFromMainFile(location))
+                return false;
+        if (filter->skip_system_headers && clang_Location_isInSystemHeader(location))
+                return false;
+        if (filter->files != NULL) {
+                CXFile file;
+                clang_getExpansionLocation(location, &file, NULL, NULL, NULL);
+                for (int i = 0; i < filter->num_files; i++) {
+                        if (file != NULL && file == filter->files[i])
+                                return true;
+                }
+                return false;
+        }
+        return true;
+}
+
+/* Check whether 'cursor' passes the filter */
+static bool filter_accepts(const cursor_filter *filter, CXCursor cursor)
+{
+        return kind_set_has(&filter->kinds, clang_getCursorKind(cursor)) && filter_accepts_location(filter, cursor);
+}
+
+typedef struct visit_state {
+        lua_State *L;
+        int nargs;                      /* visitor function and extra params, at the bottom of the stack */
+        const cursor_filter *filter;    /* NULL if every cursor is passed to the visitor */
+        CXCursor *cur, *par;            /* reused cursor objects, NULL if new ones are created per node */
+        unsigned long long visited, callbacks;
+        bool failed;                    /* error message left on top of the stack */
+} visit_state;
+
+enum CXChildVisitResult visitor_function(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        visit_state *state = (visit_state *) client_data;
+        lua_State *L = state->L;
+        state->visited++;
+        if (state->filter != NULL) {
+                /* the children of a cursor of another kind may still be of the selected kinds */
+                if (!filter_accepts_location(state->filter, cursor))
+                        return CXChildVisit_Continue;
+                if (!kind_set_has(&state->filter->kinds, clang_getCursorKind(cursor)))
+                        return CXChildVisit_Recurse;
+        }
+        state->callbacks++;
+        int nargs = state->nargs;
+        lua_pushvalue(L, 1);    
+        if (state->cur != NULL) {
+                /* the reused objects are stored right above the params */
+                *state->cur = cursor;
+                *state->par = parent;
+                lua_pushvalue(L, nargs+1);
+                lua_pushvalue(L, nargs+2);
+        } else {
+                push_cursor(L, cursor);
+                push_cursor(L, parent);
+        }
+        for (int i = 2; i <= nargs; i++) {
+                lua_pushvalue(L, i);
+        }
+        if (lua_pcall(L, nargs+1, 1, 0) != 0) {
+                state->failed = true;
+                return CXChildVisit_Break;
+        }
+        const char *result = lua_tostring(L, -1);
+        if (result == NULL) {
+                lua_pushstring(L, "undefined return to visitor");
+                state->failed = true;
+                return CXChildVisit_Break;
+        }
+        else if (strcmp(result, "continue") == 0) {
+                lua_pop(L, 1);
+                return CXChildVisit_Continue;
+        }
+        else if (strcmp(result, "recurse") == 0) {
+                lua_pop(L, 1);
+                return CXChildVisit_Recurse;
+        }
+        else if (strcmp(result, "break") == 0) {
+                lua_pop(L, 1);
+                return CXChildVisit_Break;
+        }
+        else {
+                lua_pushstring(L, "undefined return to visitor");
+                state->failed = true;
+                return CXChildVisit_Break;
+        }
+}
+
+/*      
+        Format - cur:visitChildren([options,] visitor_function, ...)
+        Parameters - cur - Cursor whose children are to be visited  
+                   - options - Optional table filtering the cursors in C, see check_cursor_filter() :
+                        kinds, mainFileOnly, skipSystemHeaders and files. A cursor of another
+                        kind is skipped without calling the visitor_function, but its children
+                        are visited. A cursor rejected by the location filters is skipped
+                        together with its children.
+                        With reuseCursors = true, the same two cursor objects are passed for every
+                        node and overwritten in place, so the traversal doesn't allocate. Such a
+                        cursor is only valid during the call, use cursor:clone() to keep it.
+                   - ... - Extra params passed to the visitor_function after the cursor and its parent
+        A string should be returned by the visitor_function to indicate how visit_children should proceed : 
+                1. "break" - Terminates the cursor traversal 
+                2. "continue" - Continues the cursor traversal with the next sibling of the cursor just visited, without visiting its children
+                3. "recurse" - Recursively traverse the children of this cursor, using the same visitor and client data
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__TRAVERSAL.html#ga5d0a813d937e1a7dcc35f206ad1f7a91
+                  - https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html
+        Returns nothing
+*/
+static int cursor_visitchildren(lua_State *L)                               
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        visit_state state;
+        cursor_filter filter;
+        bool reuse_cursors = false;
+        state.L = L;
+        state.filter = NULL;
+        state.cur = state.par = NULL;
+        state.visited = state.callbacks = 0;
+        state.failed = false;
+        filter.files = NULL;
+        if (lua_istable(L, 2)) {
+                luaL_checktype(L, 3, LUA_TFUNCTION);
+                reuse_cursors = opt_boolean(L, 2, "reuseCursors", false);
+                check_cursor_filter(L, 2, clang_Cursor_getTranslationUnit(*cur), &filter);
+                state.filter = &filter;
+                lua_remove(L, 2);
+        }
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+        lua_remove(L, 1);
+        state.nargs = lua_gettop(L);
+        if (!lua_checkstack(L, lua_gettop(L)+8)) {
+                free(filter.files);
+                luaL_error(L, "excessive number of params");       
+        }
+        if (reuse_cursors) {
+                new_object(L, state.cur, CURSOR_METATABLE);
+                new_object(L, state.par, CURSOR_METATABLE);
+        }
+        clang_visitChildren(*cur, visitor_function, &state);
+        free(filter.files);
+        parser_counters *stats = find_stats(L, clang_Cursor_getTranslationUnit(*cur));
+        if (stats != NULL) {
+                stats->cursors_visited += state.visited;
+                stats->callbacks += state.callbacks;
+        }
+        if (state.failed) {
+                luaL_error(L, lua_tostring(L, lua_gettop(L)));
+                return 1;
+        }
+        return 0;
+}
+
+
+/* Children of one cursor, stepped through by a cursor iterator */
+typedef struct cursor_frame {
+        CXCursor *cursors;
+        unsigned count;
+        unsigned next;          /* index of the next cursor to be returned */
+} cursor_frame;
+
+typedef struct cursor_iterator {
+        cursor_frame *frames;   /* frames[0] holds the children of the cursor iterated over */
+        int depth;              /* number of frames in use */
+        int capacity;
+        bool recursive;         /* descendants rather than children */
+        bool expand;            /* the children of 'last' are to be visited next */
+        CXCursor last;          /* cursor returned by the last step */
+} cursor_iterator;
+
+typedef struct collect_state {
+        cursor_frame *frame;
+        unsigned capacity;
+        bool failed;            /* out of memory */
+} collect_state;
+
+enum CXChildVisitResult collect_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        collect_state *state = (collect_state *) client_data;
+        cursor_frame *frame = state->frame;
+        if (frame->count == state->capacity) {
+                unsigned capacity = state->capacity ? state->capacity * 2 : 16;
+                CXCursor *cursors = realloc(frame->cursors, capacity * sizeof(CXCursor));
+                if (cursors == NULL) {
+                        state->failed = true;
+                        return CXChildVisit_Break;
+                }
+                frame->cursors = cursors;
+                state->capacity = capacity;
+        }
+        frame->cursors[frame->count++] = cursor;
+        return CXChildVisit_Continue;
+}
+
+/* Push a frame holding the children of 'cursor', nothing is pushed if it has none */
+static void iterator_push_children(lua_State *L, cursor_iterator *it, CXCursor cursor)
+{
+        cursor_frame frame = {NULL, 0, 0};
+        collect_state state = {&frame, 0, false};
+        clang_visitChildren(cursor, collect_visitor, &state);
+        if (state.failed) {
+                free(frame.cursors);
+                luaL_error(L, "not enough memory");
+        }
+        parser_counters *stats = find_stats(L, clang_Cursor_getTranslationUnit(cursor));
+        if (stats != NULL)
+                stats->cursors_visited += frame.count;
+        if (frame.count == 0)
+                return;
+        if (it->depth == it->capacity) {
+                int capacity = it->capacity ? it->capacity * 2 : 8;
+                cursor_frame *frames = realloc(it->frames, capacity * sizeof(cursor_frame));
+                if (frames == NULL) {
+                        free(frame.cursors);
+                        luaL_error(L, "not enough memory");
+                }
+                it->frames = frames;
+                it->capacity = capacity;
+        }
+        it->frames[it->depth++] = frame;
+}
+
+static int new_cursor_iterator(lua_State *L, bool recursive)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        cursor_iterator *it;
+        new_object(L, it, CURSOR_ITERATOR_METATABLE);
+        it->frames = NULL;
+        it->depth = it->capacity = 0;
+        it->recursive = recursive;
+        it->expand = false;
+        iterator_push_children(L, it, *cur);
+        return 1;
+}
+
+/*
+        Format - for cursor in cur:children() do ... end
+        Parameter - cur - Cursor whose direct children are to be iterated over
+        The children are collected into a C array when the iterator is created and returned
+        one at a time, no Lua function is called from C, so the loop body may yield.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__TRAVERSAL.html
+        Returns an iterator for the generic for
+*/
+static int cursor_children(lua_State *L)
+{
+        return new_cursor_iterator(L, false);
+}
+
+/*
+        Format - for cursor, depth in cur:descendants() do ... end
+        Parameter - cur - Cursor whose descendants are to be iterated over
+        The descendants are visited depth first, the children of a cursor being collected when
+        the iteration moves into it. Calling iterator:prune() skips the children of the cursor
+        just returned. Depth is 1 for the children of cur.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__TRAVERSAL.html
+        Returns an iterator for the generic for
+*/
+static int cursor_descendants(lua_State *L)
+{
+        return new_cursor_iterator(L, true);
+}
+
+/* Step of the iterator, returns the next cursor and its depth, nil at the end */
+static int iterator_call(lua_State *L)
+{
+        cursor_iterator *it;
+        to_object(L, it, CURSOR_ITERATOR_METATABLE, 1);
+        if (it->expand) {
+                it->expand = false;
+                iterator_push_children(L, it, it->last);
+        }
+        while (it->depth > 0) {
+                cursor_frame *frame = &it->frames[it->depth-1];
+                if (frame->next < frame->count) {
+                        it->last = frame->cursors[frame->next++];
+                        it->expand = it->recursive;
+                        push_cursor(L, it->last);
+                        lua_pushinteger(L, it->depth);
+                        return 2;
+                }
+                free(frame->cursors);
+                it->depth--;
+        }
+        lua_pushnil(L);
+        return 1;
+}
+
+/*
+        Format - iterator:prune()
+        Parameter - iterator - Iterator returned by cur:descendants()
+        Skips the children of the cursor returned by the last step
+        Returns nothing
+*/
+static int iterator_prune(lua_State *L)
+{
+        cursor_iterator *it;
+        to_object(L, it, CURSOR_ITERATOR_METATABLE, 1);
+        it->expand = false;
+        return 0;
+}
+
+static int iterator_gc(lua_State *L)
+{
+        cursor_iterator *it;
+        to_object(L, it, CURSOR_ITERATOR_METATABLE, 1);
+        while (it->depth > 0)
+                free(it->frames[--it->depth].cursors);
+        free(it->frames);
+        it->frames = NULL;
+        it->capacity = 0;
+        return 0;
+}
+
+typedef struct extract_state {
+        lua_State *L;
+        kind_set kinds;
+        int max_depth;
+        int depth;              /* depth of the cursors being visited */
+        CXFile last_file;       /* file whose name is stored at 'file_slot' */
+        int file_slot;
+        unsigned long long visited;
+        bool failed;            /* the Lua stack couldn't grow */
+} extract_state;
+
+/* Append the value on top of the stack to the list 'field' of the table at 'parent' (its array part if NULL) */
+static void append_to(lua_State *L, int parent, const char *field)
+{
+        if (field == NULL) {
+                lua_rawseti(L, parent, luaL_len(L, parent) + 1);
+                return;
+        }
+        if (lua_getfield(L, parent, field) == LUA_TNIL) {
+                lua_pop(L, 1);
+                lua_newtable(L);
+                lua_pushvalue(L, -1);
+                lua_setfield(L, parent, field);
+        }
+        lua_insert(L, -2);
+        lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+        lua_pop(L, 1);
+}
+
+/* Set the file, line and column fields of the record on top of the stack */
+static void set_location(extract_state *state, CXCursor cursor)
+{
+        lua_State *L = state->L;
+        CXFile file;
+        unsigned int line, column;
+        clang_getSpellingLocation(clang_getCursorLocation(cursor), &file, &line, &column, NULL);
+        if (file != NULL) {
+                if (file != state->last_file) {
+                        push_cxstring(L, clang_getFileName(file));
+                        lua_replace(L, state->file_slot);
+                        state->last_file = file;
+                }
+                lua_pushvalue(L, state->file_slot);
+                lua_setfield(L, -2, "file");
+        }
+        lua_pushinteger(L, line);
+        lua_setfield(L, -2, "line");
+        lua_pushinteger(L, column);
+        lua_setfield(L, -2, "column");
+}
+
+static enum CXChildVisitResult extract_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data);
+
+/* Push the record describing 'cursor' */
+static void push_record(extract_state *state, CXCursor cursor)
+{
+        lua_State *L = state->L;
+        enum CXCursorKind kind = clang_getCursorKind(cursor);
+        lua_createtable(L, 0, 8);
+        lua_pushstring(L, cursor_kind_str(kind));
+        lua_setfield(L, -2, "kind");
+        push_cxstring(L, clang_getCursorSpelling(cursor));
+        lua_setfield(L, -2, "spelling");
+        push_cxstring(L, clang_getTypeSpelling(clang_getCursorType(cursor)));
+        lua_setfield(L, -2, "type");
+        set_location(state, cursor);
+        switch (kind) {
+                case CXCursor_StructDecl:
+                case CXCursor_UnionDecl:
+                case CXCursor_EnumDecl:
+                        lua_pushboolean(L, clang_isCursorDefinition(cursor));
+                        lua_setfield(L, -2, "isDefinition");
+                        break;
+                case CXCursor_FunctionDecl:
+                        push_cxstring(L, clang_getTypeSpelling(clang_getCursorResultType(cursor)));
+                        lua_setfield(L, -2, "result");
+                        lua_pushboolean(L, clang_Cursor_isVariadic(cursor));
+                        lua_setfield(L, -2, "isVariadic");
+                        lua_pushboolean(L, clang_Cursor_isFunctionInlined(cursor));
+                        lua_setfield(L, -2, "isInlined");
+                        /* fall through */
+                case CXCursor_VarDecl:
+                        lua_pushstring(L, storage_class_str(clang_Cursor_getStorageClass(cursor)));
+                        lua_setfield(L, -2, "storage");
+                        break;
+                case CXCursor_FieldDecl:
+                        if (clang_Cursor_isBitField(cursor)) {
+                                lua_pushinteger(L, clang_getFieldDeclBitWidth(cursor));
+                                lua_setfield(L, -2, "bitWidth");
+                        }
+                        break;
+                case CXCursor_EnumConstantDecl:
+                        lua_pushinteger(L, clang_getEnumConstantDeclValue(cursor));
+                        lua_setfield(L, -2, "value");
+                        break;
+                case CXCursor_TypedefDecl:
+                        push_cxstring(L, clang_getTypeSpelling(clang_getTypedefDeclUnderlyingType(cursor)));
+                        lua_setfield(L, -2, "underlying");
+                        break;
+                default:
+                        break;
+        }
+        /* fields, args, enum values and nested declarations */
+        switch (kind) {
+                case CXCursor_StructDecl:
+                case CXCursor_UnionDecl:
+                case CXCursor_EnumDecl:
+                case CXCursor_FunctionDecl:
+                        state->depth++;
+                        clang_visitChildren(cursor, extract_visitor, state);
+                        state->depth--;
+                        break;
+                default:
+                        break;
+        }
+}
+
+static enum CXChildVisitResult extract_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        extract_state *state = (extract_state *) client_data;
+        lua_State *L = state->L;
+        enum CXCursorKind kind = clang_getCursorKind(cursor);
+        enum CXCursorKind parent_kind = clang_getCursorKind(parent);
+        const char *list = "children";
+        state->visited++;
+        if (!clang_isDeclaration(kind))
+                return CXChildVisit_Continue;
+        if (kind == CXCursor_FieldDecl && (parent_kind == CXCursor_StructDecl || parent_kind == CXCursor_UnionDecl))
+                list = "fields";
+        else if (kind == CXCursor_ParmDecl && parent_kind == CXCursor_FunctionDecl)
+                list = "args";
+        else if (kind == CXCursor_EnumConstantDecl && parent_kind == CXCursor_EnumDecl)
+                list = "values";
+        else if (!kind_set_has(&state->kinds, kind) || state->depth > state->max_depth)
+                return CXChildVisit_Continue;
+        if (state->depth == 1)
+                list = NULL;
+        if (!lua_checkstack(L, 8)) {
+                state->failed = true;
+                return CXChildVisit_Break;
+        }
+        int parent_record = lua_gettop(L);
+        push_record(state, cursor);
+        append_to(L, parent_record, list);
+        return state->failed ? CXChildVisit_Break : CXChildVisit_Continue;
+}
+
+/* Read the kinds and maxDepth fields of the options table at 'arg' into 'state' */
+static void check_extract_options(lua_State *L, int arg, extract_state *state)
+{
+        state->L = L;
+        state->max_depth = INT_MAX;
+        state->depth = 1;
+        state->last_file = NULL;
+        state->visited = 0;
+        state->failed = false;
+        if (lua_isnoneornil(L, arg)) {
+                memset(&state->kinds, 0, sizeof(state->kinds));
+                state->kinds.all = true;
+                return;
+        }
+        luaL_checktype(L, arg, LUA_TTABLE);
+        lua_getfield(L, arg, "kinds");
+        check_kind_set(L, arg, lua_gettop(L), &state->kinds);
+        lua_getfield(L, arg, "maxDepth");
+        if (!lua_isnil(L, -1)) {
+                luaL_argcheck(L, lua_isinteger(L, -1), arg, "expect integer maxDepth");
+                state->max_depth = lua_tointeger(L, -1);
+        }
+        lua_pop(L, 2);
+}
+
+/* Push the array of declarations extracted from the children of 'cursor', see cur:extract() */
+static void push_extract(lua_State *L, CXCursor cursor, extract_state *state)
+{
+        lua_pushnil(L);
+        state->file_slot = lua_gettop(L);
+        lua_newtable(L);
+        clang_visitChildren(cursor, extract_visitor, state);
+        parser_counters *stats = find_stats(L, clang_Cursor_getTranslationUnit(cursor));
+        if (stats != NULL)
+                stats->cursors_visited += state->visited;
+        if (state->failed)
+                luaL_error(L, "stack overflow while extracting declarations");
+        lua_remove(L, state->file_slot);
+}
+
+/*
+        Format - cur:extract([options])
+        Parameters - cur - Cursor whose child declarations are to be extracted
+                   - options - Optional table with the fields :
+                        1. kinds - Array of cursor kinds (as returned by cur:getKind()) to extract, all declarations by default
+                        2. maxDepth - Maximum nesting of the extracted declarations, unlimited by default
+        The whole tree is walked in C, the visitor never calls back into Lua. Each declaration is
+        described by a table with the fields kind, spelling, type, file, line and column, plus :
+                - StructDecl, UnionDecl - isDefinition, fields
+                - EnumDecl - isDefinition, values
+                - FunctionDecl - result, isVariadic, isInlined, storage, args
+                - VarDecl - storage
+                - FieldDecl - bitWidth (bit fields only)
+                - EnumConstantDecl - value
+                - TypedefDecl - underlying
+                - children - nested declarations matching the options
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__TRAVERSAL.html#ga5d0a813d937e1a7dcc35f206ad1f7a91
+        Returns an array with the description of each child declaration
+*/
+static int cursor_extract(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        extract_state state;
+        check_extract_options(L, 2, &state);
+        push_extract(L, *cur, &state);
+        return 1;
+}
+
+/* Growable string buffer, filled without touching the Lua state */
+typedef struct strbuf {
+        char *data;
+        size_t len;
+        size_t size;
+        bool failed;            /* out of memory, the contents are incomplete */
+} strbuf;
+
+static void strbuf_insert(strbuf *buf, size_t pos, const char *str, size_t len)
+{
+        if (buf->failed)
+                return;
+        if (buf->len + len + 1 > buf->size) {
+                size_t size = buf->size ? buf->size : 256;
+                while (buf->len + len + 1 > size)
+                        size *= 2;
+                char *data = (char *) realloc(buf->data, size);
+                if (data == NULL) {
+                        buf->failed = true;
+                        return;
+                }
+                buf->data = data;
+                buf->size = size;
+        }
+        memmove(buf->data + pos + len, buf->data + pos, buf->len - pos);
+        memcpy(buf->data + pos, str, len);
+        buf->len += len;
+        buf->data[buf->len] = '\0';
+}
+
+static void strbuf_addstr(strbuf *buf, const char *str)
+{
+        strbuf_insert(buf, buf->len, str, strlen(str));
+}
+
+static void strbuf_addcxstring(strbuf *buf, CXString str)
+{
+        strbuf_addstr(buf, clang_getCString(str));
+        clang_disposeString(str);
+}
+
+static void strbuf_addint(strbuf *buf, long long value)
+{
+        char num[32];
+        snprintf(num, sizeof(num), "%lld", value);
+        strbuf_addstr(buf, num);
+}
+
+static void strbuf_indent(strbuf *buf, int indent)
+{
+        for (int i = 0; i < indent; i++)
+                strbuf_addstr(buf, "    ");
+}
+
+static void emit_declaration(strbuf *out, CXType type, const char *name, CXCursor scope, int indent);
+
+/*
+        Check whether the struct, union or enum 'decl' can be referred to by its tag. This isn't the
+        case for unnamed ones, including those only named by a typedef, eg. typedef struct {...} T;
+*/
+static bool has_tag_name(CXCursor decl)
+{
+        if (clang_Cursor_isAnonymous(decl))
+                return false;
+        CXString spelling = clang_getTypeSpelling(clang_getCursorType(decl));
+        const char *str = clang_getCString(spelling);
+        bool tagged = strncmp(str, "struct ", 7) == 0 || strncmp(str, "union ", 6) == 0 || strncmp(str, "enum ", 5) == 0;
+        clang_disposeString(spelling);
+        return tagged;
+}
+
+static const char *tag_keyword(CXCursor decl)
+{
+        switch (clang_getCursorKind(decl)) {
+                case CXCursor_StructDecl:
+                        return "struct";
+                case CXCursor_UnionDecl:
+                        return "union";
+                default:
+                        return "enum";
+        }
+}
+
+static enum CXChildVisitResult emit_member(CXCursor cursor, CXCursor parent, CXClientData client_data);
+
+typedef struct emit_state {
+        strbuf *out;
+        int indent;
+        const cursor_filter *filter;    /* top level declarations only */
+} emit_state;
+
+/* Append the definition of the struct, union or enum 'decl', without the trailing semicolon */
+static void emit_body(strbuf *out, CXCursor decl, int indent)
+{
+        strbuf_addstr(out, tag_keyword(decl));
+        if (has_tag_name(decl)) {
+                strbuf_addstr(out, " ");
+                strbuf_addcxstring(out, clang_getCursorSpelling(decl));
+        }
+        strbuf_addstr(out, " {\n");
+        emit_state state = {out, indent + 1, NULL};
+        clang_visitChildren(decl, emit_member, &state);
+        strbuf_indent(out, indent);
+        strbuf_addstr(out, "}");
+}
+
+/* Append a field, enum constant or anonymous struct/union member of the definition being emitted */
+static enum CXChildVisitResult emit_member(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        emit_state *state = (emit_state *) client_data;
+        strbuf *out = state->out;
+        switch (clang_getCursorKind(cursor)) {
+                case CXCursor_EnumConstantDecl:
+                        strbuf_indent(out, state->indent);
+                        strbuf_addcxstring(out, clang_getCursorSpelling(cursor));
+                        strbuf_addstr(out, " = ");
+                        strbuf_addint(out, clang_getEnumConstantDeclValue(cursor));
+                        strbuf_addstr(out, ",\n");
+                        break;
+                case CXCursor_FieldDecl: {
+                        CXString name = clang_getCursorSpelling(cursor);
+                        strbuf_indent(out, state->indent);
+                        emit_declaration(out, clang_getCursorType(cursor), clang_getCString(name), parent, state->indent);
+                        clang_disposeString(name);
+                        if (clang_Cursor_isBitField(cursor)) {
+                                strbuf_addstr(out, " : ");
+                                strbuf_addint(out, clang_getFieldDeclBitWidth(cursor));
+                        }
+                        strbuf_addstr(out, ";\n");
+                        break;
+                }
+                case CXCursor_StructDecl:
+                case CXCursor_UnionDecl:
+                        if (clang_Cursor_isAnonymousRecordDecl(cursor)) {
+                                strbuf_indent(out, state->indent);
+                                emit_body(out, cursor, state->indent);
+                                strbuf_addstr(out, ";\n");
+                        }
+                        break;
+                default:
+                        break;
+        }
+        return CXChildVisit_Continue;
+}
+
+/* Check whether the struct, union or enum 'decl' is to be defined where it is used in 'scope' */
+static bool is_inline_definition(CXCursor decl, CXCursor scope)
+{
+        switch (clang_getCursorKind(decl)) {
+                case CXCursor_StructDecl:
+                case CXCursor_UnionDecl:
+                case CXCursor_EnumDecl:
+                        break;
+                default:
+                        return false;
+        }
+        if (!has_tag_name(decl))
+                return true;
+        return clang_isCursorDefinition(decl) && clang_equalCursors(clang_getCursorLexicalParent(decl), scope);
+}
+
+/*
+        Append the declaration of 'name' (an abstract declarator if empty) with 'type'. The
+        declarator is built from the inside out, eg. int (*name[2])(char) is a ConstantArray
+        of Pointer to FunctionProto. Records defined by the declaration are emitted inline.
+*/
+static void emit_declaration(strbuf *out, CXType type, const char *name, CXCursor scope, int indent)
+{
+        strbuf decl = {NULL, 0, 0, false};
+        strbuf_addstr(&decl, name);
+        for (;;) {
+                switch (type.kind) {
+                        case CXType_Pointer: {
+                                CXType pointee = clang_getPointeeType(type);
+                                const char *prefix = "*";
+                                if (clang_isConstQualifiedType(type))
+                                        prefix = decl.len > 0 ? "*const " : "*const";
+                                strbuf_insert(&decl, 0, prefix, strlen(prefix));
+                                if (pointee.kind == CXType_ConstantArray || pointee.kind == CXType_IncompleteArray ||
+                                    pointee.kind == CXType_FunctionProto || pointee.kind == CXType_FunctionNoProto) {
+                                        strbuf_insert(&decl, 0, "(", 1);
+                                        strbuf_addstr(&decl, ")");
+                                }
+                                type = pointee;
+                                continue;
+                        }
+                        case CXType_ConstantArray:
+                                strbuf_addstr(&decl, "[");
+                                strbuf_addint(&decl, clang_getArraySize(type));
+                                strbuf_addstr(&decl, "]");
+                                type = clang_getArrayElementType(type);
+                                continue;
+                        case CXType_IncompleteArray:
+                        case CXType_VariableArray:
+                                strbuf_addstr(&decl, "[]");
+                                type = clang_getArrayElementType(type);
+                                continue;
+                        case CXType_FunctionNoProto:
+                                strbuf_addstr(&decl, "()");
+                                type = clang_getResultType(type);
+                                continue;
+                        case CXType_FunctionProto: {
+                                int num_args = clang_getNumArgTypes(type);
+                                strbuf_addstr(&decl, "(");
+                                for (int i = 0; i < num_args; i++) {
+                                        if (i > 0)
+                                                strbuf_addstr(&decl, ", ");
+                                        emit_declaration(&decl, clang_getArgType(type, i), "", clang_getNullCursor(), indent);
+                                }
+                                if (clang_isFunctionTypeVariadic(type))
+                                        strbuf_addstr(&decl, num_args > 0 ? ", ..." : "...");
+                                else if (num_args == 0)
+                                        strbuf_addstr(&decl, "void");
+                                strbuf_addstr(&decl, ")");
+                                type = clang_getResultType(type);
+                                continue;
+                        }
+                        case CXType_Attributed:
+                                type = clang_Type_getModifiedType(type);
+                                continue;
+                        default:
+                                break;
+                }
+                break;
+        }
+        CXCursor type_decl = clang_getTypeDeclaration(type);
+        if (!clang_Cursor_isNull(type_decl) && is_inline_definition(type_decl, scope)) {
+                if (clang_isConstQualifiedType(type))
+                        strbuf_addstr(out, "const ");
+                emit_body(out, type_decl, indent);
+        } else {
+                strbuf_addcxstring(out, clang_getTypeSpelling(type));
+        }
+        if (decl.len > 0) {
+                strbuf_addstr(out, " ");
+                strbuf_addstr(out, decl.data);
+        }
+        if (decl.failed)
+                out->failed = true;
+        free(decl.data);
+}
+
+/* Append the cdef of a top level declaration */
+static enum CXChildVisitResult emit_top_level(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        emit_state *state = (emit_state *) client_data;
+        strbuf *out = state->out;
+        if (state->filter != NULL && !filter_accepts(state->filter, cursor))
+                return CXChildVisit_Continue;
+        enum CXCursorKind kind = clang_getCursorKind(cursor);
+        switch (kind) {
+                case CXCursor_StructDecl:
+                case CXCursor_UnionDecl:
+                case CXCursor_EnumDecl:
+                        if (has_tag_name(cursor)) {
+                                if (clang_isCursorDefinition(cursor)) {
+                                        emit_body(out, cursor, 0);
+                                } else {
+                                        strbuf_addstr(out, tag_keyword(cursor));
+                                        strbuf_addstr(out, " ");
+                                        strbuf_addcxstring(out, clang_getCursorSpelling(cursor));
+                                }
+                        } else if (kind == CXCursor_EnumDecl && clang_Cursor_isAnonymous(cursor)) {
+                                emit_body(out, cursor, 0);      /* enum { CONSTANT = 1 }; */
+                        } else {
+                                return CXChildVisit_Continue;   /* defined where it is used */
+                        }
+                        break;
+                case CXCursor_TypedefDecl: {
+                        CXString name = clang_getCursorSpelling(cursor);
+                        strbuf_addstr(out, "typedef ");
+                        emit_declaration(out, clang_getTypedefDeclUnderlyingType(cursor), clang_getCString(name),
+                                         clang_getNullCursor(), 0);
+                        clang_disposeString(name);
+                        break;
+                }
+                case CXCursor_FunctionDecl:
+                case CXCursor_VarDecl: {
+                        enum CX_StorageClass storage = clang_Cursor_getStorageClass(cursor);
+                        if (storage == CX_SC_Static)
+                                return CXChildVisit_Continue;
+                        CXString name = clang_getCursorSpelling(cursor);
+                        if (kind == CXCursor_VarDecl)
+                                strbuf_addstr(out, "extern ");
+                        emit_declaration(out, clang_getCursorType(cursor), clang_getCString(name),
+                                         clang_getNullCursor(), 0);
+                        clang_disposeString(name);
+                        break;
+                }
+                default:
+                        return CXChildVisit_Continue;
+        }
+        strbuf_addstr(out, ";\n");
+        return out->failed ? CXChildVisit_Break : CXChildVisit_Continue;
+}
+
+/*
+        Format - cur:getCdef([options])
+        Parameters - cur - Cursor whose child declarations are to be emitted, usually the translation unit cursor
+                   - options - Optional table filtering the declarations, as accepted by cur:visitChildren()
+        Emits C declarations for the LuaJIT FFI (ffi.cdef) in a single pass over the tree, covering structs
+        and unions (with bit fields), enums with their values, typedefs, function prototypes and variables.
+        Static functions and variables are left out, and unnamed records are defined where they are used.
+        More info - https://luajit.org/ext_ffi_api.html
+        Returns a string with the declarations
+*/
+static int cursor_getcdef(lua_State *L)
+{
+        CXCursor *cur;
+        to_object(L, cur, CURSOR_METATABLE, 1);
+        cursor_filter filter;
+        filter.files = NULL;
+        strbuf out = {NULL, 0, 0, false};
+        emit_state state = {&out, 0, NULL};
+        if (!lua_isnoneornil(L, 2)) {
+                luaL_checktype(L, 2, LUA_TTABLE);
+                check_cursor_filter(L, 2, clang_Cursor_getTranslationUnit(*cur), &filter);
+                state.filter = &filter;
+        }
+        clang_visitChildren(*cur, emit_top_level, &state);
+        free(filter.files);
+        if (out.failed) {
+                free(out.data);
+                return luaL_error(L, "not enough memory");
+        }
+        lua_pushlstring(L, out.data != NULL ? out.data : "", out.len);
+        free(out.data);
+        return 1;
+}
+
+/* --Declaration cache-- */
+
+/*
+        Entries of the declaration cache written by luaclang.extractCached(), one file per key :
+                "LCDC", version (u32), key length (u32), key
+                number of dependencies (u32), then for each : name length (u32), name, size (u64), hash (u64)
+                extracted declarations, see serialize_value()
+        Integers are stored in host byte order, the cache isn't meant to be shared across machines.
+        The entry is memory-mapped when loaded and decoded straight from the mapping.
+*/
+#define CACHE_MAGIC "LCDC"
+#define CACHE_VERSION 1
+#define CACHE_MAX_DEPTH 200
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < len; i++)
+                hash = (hash ^ bytes[i]) * FNV_PRIME;
+        return hash;
+}
+
+static void strbuf_addraw(strbuf *buf, const void *data, size_t len)
+{
+        strbuf_insert(buf, buf->len, (const char *) data, len);
+}
+
+static void strbuf_addu32(strbuf *buf, uint32_t value)
+{
+        strbuf_addraw(buf, &value, sizeof(value));
+}
+
+static void strbuf_addu64(strbuf *buf, uint64_t value)
+{
+        strbuf_addraw(buf, &value, sizeof(value));
+}
+
+/* Memory-map 'path' read-only, an empty file is mapped to "" */
+static const char *map_file(const char *path, size_t *size)
+{
+        int fd = open(path, O_RDONLY);
+        if (fd == -1)
+                return NULL;
+        struct stat st;
+        const char *data = NULL;
+        if (fstat(fd, &st) == 0) {
+                *size = st.st_size;
+                if (st.st_size == 0) {
+                        data = "";
+                } else {
+                        data = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if (data == MAP_FAILED)
+                                data = NULL;
+                }
+        }
+        close(fd);
+        return data;
+}
+
+static void unmap_file(const char *data, size_t size)
+{
+        if (size > 0)
+                munmap((void *) data, size);
+}
+
+/* Hash the current contents of 'file_name', taken from the unsaved files if given there */
+static bool hash_file(const parse_options *opts, const char *file_name, uint64_t *size, uint64_t *hash)
+{
+        for (unsigned i = 0; i < opts->num_unsaved; i++) {
+                if (strcmp(opts->unsaved[i].Filename, file_name) == 0) {
+                        *size = opts->unsaved[i].Length;
+                        *hash = fnv1a(FNV_OFFSET, opts->unsaved[i].Contents, opts->unsaved[i].Length);
+                        return true;
+                }
+        }
+        size_t len;
+        const char *data = map_file(file_name, &len);
+        if (data == NULL)
+                return false;
+        *size = len;
+        *hash = fnv1a(FNV_OFFSET, data, len);
+        unmap_file(data, len);
+        return true;
+}
+
+/*
+        Append the value at 'idx' : 'S' u32 length + bytes, 'I' i64, 'N' double, 'T'/'F' booleans,
+        'H' u32 array length + u32 number of string keys, the array items, then key/value pairs.
+        Returns false for values which can't be serialized.
+*/
+static bool serialize_value(lua_State *L, int idx, strbuf *out, int depth)
+{
+        switch (lua_type(L, idx)) {
+                case LUA_TSTRING: {
+                        size_t len;
+                        const char *str = lua_tolstring(L, idx, &len);
+                        strbuf_addraw(out, "S", 1);
+                        strbuf_addu32(out, len);
+                        strbuf_addraw(out, str, len);
+                        return true;
+                }
+                case LUA_TNUMBER:
+                        if (lua_isinteger(L, idx)) {
+                                int64_t value = lua_tointeger(L, idx);
+                                strbuf_addraw(out, "I", 1);
+                                strbuf_addraw(out, &value, sizeof(value));
+                        } else {
+                                double value = lua_tonumber(L, idx);
+                                strbuf_addraw(out, "N", 1);
+                                strbuf_addraw(out, &value, sizeof(value));
+                        }
+                        return true;
+                case LUA_TBOOLEAN:
+                        strbuf_addraw(out, lua_toboolean(L, idx) ? "T" : "F", 1);
+                        return true;
+                case LUA_TTABLE:
+                        break;
+                default:
+                        return false;
+        }
+        if (depth > CACHE_MAX_DEPTH || !lua_checkstack(L, 3))
+                return false;
+        idx = lua_absindex(L, idx);
+        lua_Integer len = lua_rawlen(L, idx);
+        uint32_t num_keys = 0;
+        lua_pushnil(L);
+        while (lua_next(L, idx) != 0) {
+                lua_pop(L, 1);
+                if (lua_isinteger(L, -1) && lua_tointeger(L, -1) >= 1 && lua_tointeger(L, -1) <= len)
+                        continue;
+                if (lua_type(L, -1) != LUA_TSTRING) {
+                        lua_pop(L, 1);
+                        return false;
+                }
+                num_keys++;
+        }
+        strbuf_addraw(out, "H", 1);
+        strbuf_addu32(out, len);
+        strbuf_addu32(out, num_keys);
+        for (lua_Integer i = 1; i <= len; i++) {
+                lua_rawgeti(L, idx, i);
+                bool ok = serialize_value(L, -1, out, depth + 1);
+                lua_pop(L, 1);
+                if (!ok)
+                        return false;
+        }
+        lua_pushnil(L);
+        while (lua_next(L, idx) != 0) {
+                if (lua_type(L, -2) == LUA_TSTRING &&
+                    !(serialize_value(L, -2, out, depth + 1) && serialize_value(L, -1, out, depth + 1))) {
+                        lua_pop(L, 2);
+                        return false;
+                }
+                lua_pop(L, 1);
+        }
+        return true;
+}
+
+/* Bounds checked reader over a memory-mapped cache entry */
+typedef struct cache_reader {
+        const char *pos;
+        const char *end;
+        bool failed;
+} cache_reader;
+
+static const char *read_bytes(cache_reader *r, size_t len)
+{
+        if (r->failed || (size_t) (r->end - r->pos) < len) {
+                r->failed = true;
+                return NULL;
+        }
+        const char *bytes = r->pos;
+        r->pos += len;
+        return bytes;
+}
+
+static uint32_t read_u32(cache_reader *r)
+{
+        uint32_t value = 0;
+        const char *bytes = read_bytes(r, sizeof(value));
+        if (bytes != NULL)
+                memcpy(&value, bytes, sizeof(value));
+        return value;
+}
+
+static uint64_t read_u64(cache_reader *r)
+{
+        uint64_t value = 0;
+        const char *bytes = read_bytes(r, sizeof(value));
+        if (bytes != NULL)
+                memcpy(&value, bytes, sizeof(value));
+        return value;
+}
+
+/* Push the value written by serialize_value(), nil if the entry is corrupt */
+static void push_value(lua_State *L, cache_reader *r, int depth)
+{
+        const char *tag = read_bytes(r, 1);
+        if (tag == NULL || depth > CACHE_MAX_DEPTH || !lua_checkstack(L, 3)) {
+                r->failed = true;
+                lua_pushnil(L);
+                return;
+        }
+        switch (*tag) {
+                case 'S': {
+                        uint32_t len = read_u32(r);
+                        const char *str = read_bytes(r, len);
+                        if (str != NULL)
+                                lua_pushlstring(L, str, len);
+                        else
+                                lua_pushnil(L);
+                        break;
+                }
+                case 'I':
+                        lua_pushinteger(L, (int64_t) read_u64(r));
+                        break;
+                case 'N': {
+                        double value = 0;
+                        const char *bytes = read_bytes(r, sizeof(value));
+                        if (bytes != NULL)
+                                memcpy(&value, bytes, sizeof(value));
+                        lua_pushnumber(L, value);
+                        break;
+                }
+                case 'T':
+                case 'F':
+                        lua_pushboolean(L, *tag == 'T');
+                        break;
+                case 'H': {
+                        uint32_t len = read_u32(r);
+                        uint32_t num_keys = read_u32(r);
+                        if (r->failed || len + (uint64_t) num_keys > (uint64_t) (r->end - r->pos)) {
+                                r->failed = true;
+                                lua_pushnil(L);
+                                break;
+                        }
+                        lua_createtable(L, len, num_keys);
+                        for (uint32_t i = 1; !r->failed && i <= len; i++) {
+                                push_value(L, r, depth + 1);
+                                lua_rawseti(L, -2, i);
+                        }
+                        for (uint32_t i = 0; !r->failed && i < num_keys; i++) {
+                                push_value(L, r, depth + 1);
+                                push_value(L, r, depth + 1);
+                                if (lua_type(L, -2) == LUA_TSTRING)
+                                        lua_rawset(L, -3);
+                                else
+                                        lua_pop(L, 2);
+                        }
+                        break;
+                }
+                default:
+                        r->failed = true;
+                        lua_pushnil(L);
+                        break;
+        }
+}
+
+/*
+        Push the declarations stored in the entry at 'path' if its key matches and none of its
+        dependencies changed, returns false without pushing anything otherwise.
+*/
+static bool load_cache_entry(lua_State *L, const char *path, const strbuf *key, const parse_options *opts)
+{
+        size_t size;
+        const char *data = map_file(path, &size);
+        if (data == NULL)
+                return false;
+        cache_reader r = {data, data + size, false};
+        const char *magic = read_bytes(&r, 4);
+        bool valid = magic != NULL && memcmp(magic, CACHE_MAGIC, 4) == 0 && read_u32(&r) == CACHE_VERSION;
+        uint32_t key_len = read_u32(&r);
+        const char *key_data = read_bytes(&r, key_len);
+        valid = valid && key_data != NULL && key_len == key->len && memcmp(key_data, key->data, key_len) == 0;
+        uint32_t num_deps = valid ? read_u32(&r) : 0;
+        for (uint32_t i = 0; valid && i < num_deps; i++) {
+                uint32_t name_len = read_u32(&r);
+                const char *name = read_bytes(&r, name_len);
+                uint64_t dep_size = read_u64(&r), dep_hash = read_u64(&r);
+                if (r.failed || memchr(name, '\0', name_len) != NULL) {
+                        valid = false;
+                        break;
+                }
+                char *file_name = strndup(name, name_len);
+                uint64_t cur_size, cur_hash;
+                valid = file_name != NULL && hash_file(opts, file_name, &cur_size, &cur_hash) &&
+                        cur_size == dep_size && cur_hash == dep_hash;
+                free(file_name);
+        }
+        if (valid) {
+                push_value(L, &r, 0);
+                valid = !r.failed && r.pos == r.end && lua_istable(L, -1);
+                if (!valid)
+                        lua_pop(L, 1);
+        }
+        unmap_file(data, size);
+        return valid;
+}
+
+typedef struct inclusion_list {
+        CXFile *files;
+        unsigned count;
+        unsigned capacity;
+        bool failed;
+} inclusion_list;
+
+void collect_inclusion(CXFile included_file, CXSourceLocation *inclusion_stack, unsigned include_len,
+                       CXClientData client_data)
+{
+        inclusion_list *list = (inclusion_list *) client_data;
+        if (list->failed)
+                return;
+        if (list->count == list->capacity) {
+                unsigned capacity = list->capacity ? list->capacity * 2 : 32;
+                CXFile *files = (CXFile *) realloc(list->files, capacity * sizeof(CXFile));
+                if (files == NULL) {
+                        list->failed = true;
+                        return;
+                }
+                list->files = files;
+                list->capacity = capacity;
+        }
+        list->files[list->count++] = included_file;
+}
+
+/*
+        Write the declarations on top of the stack to the entry at 'path', with the files
+        of the include graph of 'tu' as dependencies. The cache is best effort, a failure
+        only leaves the entry missing. The entry is renamed into place once complete.
+*/
+static void store_cache_entry(lua_State *L, const char *path, const strbuf *key, CXTranslationUnit tu)
+{
+        inclusion_list list = {NULL, 0, 0, false};
+        clang_getInclusions(tu, collect_inclusion, &list);
+        strbuf out = {NULL, 0, 0, list.failed};
+        strbuf_addraw(&out, CACHE_MAGIC, 4);
+        strbuf_addu32(&out, CACHE_VERSION);
+        strbuf_addu32(&out, key->len);
+        strbuf_addraw(&out, key->data, key->len);
+        strbuf_addu32(&out, list.count);
+        for (unsigned i = 0; i < list.count; i++) {
+                size_t size = 0;
+                const char *contents = clang_getFileContents(tu, list.files[i], &size);
+                CXString name = clang_getFileName(list.files[i]);
+                const char *name_str = clang_getCString(name);
+                strbuf_addu32(&out, strlen(name_str));
+                strbuf_addstr(&out, name_str);
+                clang_disposeString(name);
+                strbuf_addu64(&out, size);
+                strbuf_addu64(&out, fnv1a(FNV_OFFSET, contents != NULL ? contents : "", size));
+        }
+        free(list.files);
+        bool ok = serialize_value(L, -1, &out, 0) && !out.failed;
+        char tmp_path[PATH_MAX];
+        if (ok && snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long) getpid()) < (int) sizeof(tmp_path)) {
+                FILE *file = fopen(tmp_path, "wb");
+                if (file != NULL) {
+                        ok = fwrite(out.data, 1, out.len, file) == out.len;
+                        ok = fclose(file) == 0 && ok;
+                        if (!ok || rename(tmp_path, path) != 0)
+                                remove(tmp_path);
+                }
+        }
+        free(out.data);
+}
+
+/*
+        Memory and translation unit of luaclang.extractCached(), in a userdata whose __gc releases
+        them if the extraction raises an error
+*/
+typedef struct extract_resources {
+        strbuf key;
+        CXIndex idx;
+        CXTranslationUnit tu;
+} extract_resources;
+
+static void extract_resources_release(extract_resources *res)
+{
+        if (res->tu != NULL)
+                clang_disposeTranslationUnit(res->tu);
+        if (res->idx != NULL)
+                clang_disposeIndex(res->idx);
+        free(res->key.data);
+        memset(res, 0, sizeof(*res));
+}
+
+static int extract_resources_gc(lua_State *L)
+{
+        extract_resources_release((extract_resources *) lua_touserdata(L, 1));
+        return 0;
+}
+
+/*
+        Format - luaclang.extractCached(file_name, options)
+        Parameters - file_name - The name of the source file to extract the declarations from
+                   - options - Table with the options of luaclang.newParser() and cur:extract(), and :
+                        cacheDir - Existing directory holding the cache entries
+        An entry is keyed by the file name, compiler arguments, parse flags and extract options,
+        and records the size and hash of every file of the include graph. While none of them
+        changed, the declarations are loaded from the entry without parsing the file.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__MISC.html
+        Returns the declarations, as returned by cur:extract() on the translation unit cursor,
+                and whether they were loaded from the cache
+*/
+static int clang_extractcached(lua_State *L)
+{
+        const char *file_name = luaL_checkstring(L, 1);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_getfield(L, 2, "cacheDir");
+        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 2, "expect cacheDir string");
+        const char *cache_dir = lua_tostring(L, -1);
+        parse_options opts;
+        check_parse_options(L, 2, file_name, &opts);
+        extract_state state;
+        check_extract_options(L, 2, &state);
+        if (!is_unsaved_file(&opts, file_name) && access(file_name, F_OK) == -1) {
+             return luaL_error(L, "file doesn't exist");
+        }
+        extract_resources *res;
+        new_object(L, res, EXTRACT_RESOURCES_METATABLE);
+        memset(res, 0, sizeof(*res));
+        strbuf *key = &res->key;
+        int num_args;
+        const char **args = parse_args(&opts, file_name, &num_args);
+        strbuf_addraw(key, file_name, strlen(file_name) + 1);
+        strbuf_addu32(key, num_args);
+        for (int i = 0; i < num_args; i++)
+                strbuf_addraw(key, args[i], strlen(args[i]) + 1);
+        strbuf_addu32(key, opts.flags);
+        strbuf_addraw(key, &state.kinds, sizeof(state.kinds));
+        strbuf_addu32(key, state.max_depth);
+        if (key->failed)
+                return luaL_error(L, "not enough memory");
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%016llx.lcache", cache_dir,
+                     (unsigned long long) fnv1a(FNV_OFFSET, key->data, key->len)) >= (int) sizeof(path))
+                return luaL_argerror(L, 2, "cacheDir is too long");
+        if (load_cache_entry(L, path, key, &opts)) {
+                extract_resources_release(res);
+                lua_pushboolean(L, true);
+                return 2;
+        }
+        res->idx = clang_createIndex(num_args == opts.num_args, 0);
+        if (res->idx != NULL)
+                res->tu = clang_parseTranslationUnit(res->idx, file_name, args, num_args,
+                                                     opts.unsaved, opts.num_unsaved, opts.flags);
+        if (res->tu == NULL)
+                return luaL_argerror(L, 1, "translation unit wasn't created");
+        push_extract(L, clang_getTranslationUnitCursor(res->tu), &state);
+        store_cache_entry(L, path, key, res->tu);
+        extract_resources_release(res);
+        lua_pushboolean(L, false);
+        return 2;
+}
+
+/* --Macros-- */
+
+/* Integer types of the evaluated expressions, in order of conversion rank */
+enum macro_rank {RANK_BOOL, RANK_CHAR, RANK_SHORT, RANK_INT, RANK_LONG, RANK_LLONG, NUM_RANKS};
+
+/* Integer types of the target, read from the macros predefined by the compiler */
+typedef struct macro_target {
+        int width[NUM_RANKS];   /* in bits */
+        bool char_unsigned;
+} macro_target;
+
+/* Tokens of the macro definition being evaluated, see parser:getMacros() */
+typedef struct macro_eval {
+        lua_State *L;
+        int known;              /* stack position of the table mapping evaluated macros to their value */
+        int types;              /* stack position of the table mapping evaluated macros to their type, see type_code() */
+        const macro_target *target;
+        CXToken *tokens;
+        CXString *spellings;
+        unsigned count;
+        unsigned pos;           /* next token, the macro name is token 0 */
+        int skipping;           /* inside operands which aren't evaluated, eg. the other branch of ?: */
+        bool failed;            /* not a constant expression */
+} macro_eval;
+
+typedef struct macro_number {
+        bool is_float;
+        lua_Number f;
+        uint64_t bits;          /* value of an integer, sign-extended if it is signed */
+        enum macro_rank rank;
+        bool is_unsigned;
+} macro_number;
+
+static const char *token_spelling(const macro_eval *m, unsigned i)
+{
+        return i < m->count ? clang_getCString(m->spellings[i]) : "";
+}
+
+/* Consume the next token if it is the punctuation 'punct' */
+static bool accept_punct(macro_eval *m, const char *punct)
+{
+        if (m->pos < m->count && clang_getTokenKind(m->tokens[m->pos]) == CXToken_Punctuation &&
+            strcmp(token_spelling(m, m->pos), punct) == 0) {
+                m->pos++;
+                return true;
+        }
+        return false;
+}
+
+/* Fail on an operation without defined value, unless its operand isn't evaluated */
+static void undefined_value(macro_eval *m)
+{
+        if (m->skipping == 0)
+                m->failed = true;
+}
+
+/* Decode the escape sequence or character at '*p' and advance past it */
+static int decode_char(const char **p)
+{
+        const char *s = *p;
+        int c = (unsigned char) *s++;
+        if (c == '\\') {
+                c = (unsigned char) *s++;
+                switch (c) {
+                        case 'n': c = '\n'; break;
+                        case 't': c = '\t'; break;
+                        case 'r': c = '\r'; break;
+                        case 'a': c = '\a'; break;
+                        case 'b': c = '\b'; break;
+                        case 'f': c = '\f'; break;
+                        case 'v': c = '\v'; break;
+                        case 'x':
+                                c = (int) strtol(s, (char **) &s, 16);
+                                break;
+                        default:
+                                if (c >= '0' && c <= '7') {
+                                        c -= '0';
+                                        for (int i = 0; i < 2 && *s >= '0' && *s <= '7'; i++)
+                                                c = c * 8 + (*s++ - '0');
+                                }
+                                break;
+                }
+        }
+        *p = s;
+        return c;
+}
+
+static uint64_t max_value(const macro_eval *m, enum macro_rank rank, bool is_unsigned)
+{
+        int width = m->target->width[rank];
+        uint64_t max = width < 64 ? ((uint64_t) 1 << width) - 1 : UINT64_MAX;
+        return is_unsigned ? max : max >> 1;
+}
+
+/* Set 'n' to the integer 'bits' converted to the given type, wrapping around like the C compilers */
+static void set_int(const macro_eval *m, macro_number *n, uint64_t bits, enum macro_rank rank, bool is_unsigned)
+{
+        int width = m->target->width[rank];
+        if (rank == RANK_BOOL) {
+                bits = bits != 0;
+        } else if (width < 64) {
+                bits &= ((uint64_t) 1 << width) - 1;
+                if (!is_unsigned && (bits >> (width - 1)) != 0)
+                        bits |= UINT64_MAX << width;
+        }
+        n->is_float = false;
+        n->bits = bits;
+        n->rank = rank;
+        n->is_unsigned = is_unsigned;
+}
+
+static void set_bool(const macro_eval *m, macro_number *n, bool value)
+{
+        set_int(m, n, value, RANK_INT, false);
+}
+
+static bool is_true(const macro_number *n)
+{
+        return n->is_float ? n->f != 0 : n->bits != 0;
+}
+
+static lua_Number to_number(const macro_number *n)
+{
+        if (n->is_float)
+                return n->f;
+        return n->is_unsigned ? (lua_Number) n->bits : (lua_Number) (int64_t) n->bits;
+}
+
+/* Apply the integer promotions to 'n' */
+static void promote(const macro_eval *m, macro_number *n)
+{
+        if (n->is_float || n->rank >= RANK_INT)
+                return;
+        bool fits = !n->is_unsigned || m->target->width[n->rank] < m->target->width[RANK_INT];
+        set_int(m, n, n->bits, RANK_INT, !fits);
+}
+
+/* Apply the usual arithmetic conversions to 'a' and 'b' */
+static void convert_operands(const macro_eval *m, macro_number *a, macro_number *b)
+{
+        if (a->is_float || b->is_float) {
+                a->f = to_number(a);
+                b->f = to_number(b);
+                a->is_float = b->is_float = true;
+                return;
+        }
+        promote(m, a);
+        promote(m, b);
+        enum macro_rank rank;
+        bool is_unsigned;
+        if (a->is_unsigned == b->is_unsigned) {
+                rank = a->rank > b->rank ? a->rank : b->rank;
+                is_unsigned = a->is_unsigned;
+        } else {
+                const macro_number *u = a->is_unsigned ? a : b, *s = a->is_unsigned ? b : a;
+                if (u->rank >= s->rank) {
+                        rank = u->rank;
+                        is_unsigned = true;
+                } else {
+                        rank = s->rank;
+                        is_unsigned = m->target->width[s->rank] <= m->target->width[u->rank];
+                }
+        }
+        set_int(m, a, a->bits, rank, is_unsigned);
+        set_int(m, b, b->bits, rank, is_unsigned);
+}
+
+/*
+        Parse a numeric or character literal. Integer literals get the first type of their
+        suffix which can represent them, as in C.
+*/
+static bool parse_literal(const macro_eval *m, const char *s, macro_number *n)
+{
+        if (s[0] == 'u' && s[1] == '8' && s[2] == '\'') {
+                s += 3;
+                set_int(m, n, (unsigned) decode_char(&s), RANK_CHAR, true);
+                return strcmp(s, "'") == 0;
+        }
+        if ((s[0] == 'L' || s[0] == 'u' || s[0] == 'U') && s[1] == '\'') {
+                char prefix = s[0];
+                s += 2;
+                int c = decode_char(&s);
+                if (prefix == 'L')
+                        set_int(m, n, (uint64_t) (int64_t) c, RANK_INT, false);
+                else
+                        set_int(m, n, (unsigned) c, prefix == 'u' ? RANK_SHORT : RANK_INT, true);
+                return strcmp(s, "'") == 0;
+        }
+        if (*s == '\'') {
+                s++;
+                /* the value of a plain char, converted to int */
+                macro_number c;
+                set_int(m, &c, (unsigned) decode_char(&s), RANK_CHAR, m->target->char_unsigned);
+                set_int(m, n, c.bits, RANK_INT, false);
+                return strcmp(s, "'") == 0;
+        }
+        char *end;
+        int base = 10;
+        const char *digits = s;
+        if (s[0] == '0' && (s[1] == 'b' || s[1] == 'B')) {
+                base = 2;
+                digits = s + 2;
+        } else if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+                base = 16;
+                digits = s + 2;
+        } else if (s[0] == '0') {
+                base = 8;
+        }
+        errno = 0;
+        uint64_t value = strtoull(digits, &end, base);
+        if (end == digits || *end == '.' || *end == 'e' || *end == 'E' || *end == 'p' || *end == 'P' ||
+            (base == 8 && (*end == '8' || *end == '9'))) {
+                n->is_float = true;
+                n->f = strtod(s, &end);
+                if (end == s)
+                        return false;
+                while (*end == 'f' || *end == 'F' || *end == 'l' || *end == 'L')
+                        end++;
+                return *end == '\0';
+        }
+        if (errno == ERANGE)
+                return false;
+        bool is_unsigned = false;
+        int longs = 0;
+        for (; *end != '\0'; end++) {
+                if ((*end == 'u' || *end == 'U') && !is_unsigned)
+                        is_unsigned = true;
+                else if ((*end == 'l' || *end == 'L') && longs == 0)
+                        longs = end[1] == end[0] ? 2 : 1, end += longs - 1;
+                else
+                        return false;
+        }
+        for (int rank = RANK_INT + longs; rank <= RANK_LLONG; rank++) {
+                if (!is_unsigned && value <= max_value(m, rank, false)) {
+                        set_int(m, n, value, rank, false);
+                        return true;
+                }
+                if ((is_unsigned || base != 10) && value <= max_value(m, rank, true)) {
+                        set_int(m, n, value, rank, true);
+                        return true;
+                }
+        }
+        return false;
+}
+
+static const struct {
+        const char *op;
+        int precedence;
+} binary_ops[] = {
+        {"||", 1}, {"&&", 2}, {"|", 3}, {"^", 4}, {"&", 5}, {"==", 6}, {"!=", 6},
+        {"<", 7}, {">", 7}, {"<=", 7}, {">=", 7}, {"<<", 8}, {">>", 8},
+        {"+", 9}, {"-", 9}, {"*", 10}, {"/", 10}, {"%", 10}, {NULL, 0}
+};
+
+/*
+        Apply the binary operator 'op', other than && and ||, to 'a' and 'b', storing the result
+        in 'a'. Return false if the result isn't defined by C, eg. on a division by zero.
+*/
+static bool apply_binary(const macro_eval *m, const char *op, macro_number *a, macro_number b)
+{
+        if ((op[0] == '<' && op[1] == '<') || (op[0] == '>' && op[1] == '>')) {
+                if (a->is_float || b.is_float)
+                        return false;
+                promote(m, a);
+                promote(m, &b);
+                int width = m->target->width[a->rank];
+                if ((!b.is_unsigned && (int64_t) b.bits < 0) || b.bits >= (uint64_t) width)
+                        return false;
+                if (op[0] == '<')
+                        set_int(m, a, a->bits << b.bits, a->rank, a->is_unsigned);
+                else if (a->is_unsigned)
+                        set_int(m, a, a->bits >> b.bits, a->rank, true);
+                else
+                        set_int(m, a, (uint64_t) ((int64_t) a->bits >> b.bits), a->rank, false);
+                return true;
+        }
+        convert_operands(m, a, &b);
+        if (a->is_float) {
+                lua_Number x = a->f, y = b.f;
+                switch (op[0]) {
+                        case '+': a->f = x + y; return true;
+                        case '-': a->f = x - y; return true;
+                        case '*': a->f = x * y; return true;
+                        case '/': a->f = x / y; return true;
+                        case '<': set_bool(m, a, op[1] ? x <= y : x < y); return true;
+                        case '>': set_bool(m, a, op[1] ? x >= y : x > y); return true;
+                        case '=': set_bool(m, a, x == y); return true;
+                        case '!': set_bool(m, a, x != y); return true;
+                        default: return false;
+                }
+        }
+        uint64_t x = a->bits, y = b.bits;
+        bool less = a->is_unsigned ? x < y : (int64_t) x < (int64_t) y;
+        switch (op[0]) {
+                case '+': x += y; break;
+                case '-': x -= y; break;
+                case '*': x *= y; break;
+                case '/':
+                case '%':
+                        if (y == 0)
+                                return false;
+                        if (a->is_unsigned) {
+                                x = op[0] == '/' ? x / y : x % y;
+                        } else {
+                                if ((int64_t) y == -1 && x == (UINT64_MAX << (m->target->width[a->rank] - 1)))
+                                        return false;
+                                x = (uint64_t) (op[0] == '/' ? (int64_t) x / (int64_t) y : (int64_t) x % (int64_t) y);
+                        }
+                        break;
+                case '&': x &= y; break;
+                case '|': x |= y; break;
+                case '^': x ^= y; break;
+                case '<': set_bool(m, a, op[1] ? less || x == y : less); return true;
+                case '>': set_bool(m, a, op[1] ? !less : !less && x != y); return true;
+                case '=': set_bool(m, a, x == y); return true;
+                case '!': set_bool(m, a, x != y); return true;
+                default: return false;
+        }
+        set_int(m, a, x, a->rank, a->is_unsigned);
+        return true;
+}
+
+static void eval_conditional(macro_eval *m, macro_number *n);
+
+/*
+        Parse the type name of a cast, up to the closing parenthesis. Return false if it isn't an
+        arithmetic type, otherwise set 'is_float' or the integer type in 'rank' and 'is_unsigned'.
+*/
+static bool parse_cast_type(macro_eval *m, bool *is_float, enum macro_rank *rank, bool *is_unsigned)
+{
+        int longs = 0;
+        bool is_signed = false, is_char = false, is_short = false, is_bool = false;
+        *is_float = false;
+        *is_unsigned = false;
+        while (m->pos < m->count && clang_getTokenKind(m->tokens[m->pos]) == CXToken_Keyword) {
+                const char *keyword = token_spelling(m, m->pos++);
+                if (strcmp(keyword, "long") == 0)
+                        longs++;
+                else if (strcmp(keyword, "unsigned") == 0)
+                        *is_unsigned = true;
+                else if (strcmp(keyword, "signed") == 0)
+                        is_signed = true;
+                else if (strcmp(keyword, "char") == 0)
+                        is_char = true;
+                else if (strcmp(keyword, "short") == 0)
+                        is_short = true;
+                else if (strcmp(keyword, "_Bool") == 0)
+                        is_bool = true;
+                else if (strcmp(keyword, "float") == 0 || strcmp(keyword, "double") == 0)
+                        *is_float = true;
+                else if (strcmp(keyword, "int") != 0 && strcmp(keyword, "const") != 0 && strcmp(keyword, "volatile") != 0)
+                        return false;
+        }
+        if (!accept_punct(m, ")") || longs > 2)
+                return false;
+        if (is_bool)
+                *rank = RANK_BOOL, *is_unsigned = true;
+        else if (is_char)
+                *rank = RANK_CHAR, *is_unsigned = *is_unsigned || (!is_signed && m->target->char_unsigned);
+        else if (is_short)
+                *rank = RANK_SHORT;
+        else
+                *rank = RANK_INT + longs;
+        return true;
+}
+
+static void eval_unary(macro_eval *m, macro_number *n)
+{
+        if (m->failed || m->pos >= m->count) {
+                m->failed = true;
+                return;
+        }
+        const char *s = token_spelling(m, m->pos);
+        CXTokenKind kind = clang_getTokenKind(m->tokens[m->pos]);
+        if (accept_punct(m, "+")) {
+                eval_unary(m, n);
+                promote(m, n);
+        } else if (accept_punct(m, "-")) {
+                eval_unary(m, n);
+                promote(m, n);
+                if (n->is_float)
+                        n->f = -n->f;
+                else if (!n->is_unsigned && n->bits == UINT64_MAX << (m->target->width[n->rank] - 1))
+                        undefined_value(m);
+                else
+                        set_int(m, n, 0 - n->bits, n->rank, n->is_unsigned);
+        } else if (accept_punct(m, "~")) {
+                eval_unary(m, n);
+                promote(m, n);
+                if (n->is_float)
+                        m->failed = true;
+                else
+                        set_int(m, n, ~n->bits, n->rank, n->is_unsigned);
+        } else if (accept_punct(m, "!")) {
+                eval_unary(m, n);
+                set_bool(m, n, !is_true(n));
+        } else if (accept_punct(m, "(")) {
+                if (m->pos < m->count && clang_getTokenKind(m->tokens[m->pos]) == CXToken_Keyword) {
+                        bool is_float, is_unsigned;
+                        enum macro_rank rank;
+                        if (!parse_cast_type(m, &is_float, &rank, &is_unsigned)) {
+                                m->failed = true;
+                                return;
+                        }
+                        eval_unary(m, n);
+                        if (m->failed) {
+                                return;
+                        } else if (is_float) {
+                                n->f = to_number(n);
+                                n->is_float = true;
+                        } else if (!n->is_float || rank == RANK_BOOL) {
+                                set_int(m, n, n->is_float ? n->f != 0 : n->bits, rank, is_unsigned);
+                        } else if (n->f > -1 - (lua_Number) max_value(m, rank, is_unsigned) * !is_unsigned &&
+                                   n->f < (lua_Number) max_value(m, rank, is_unsigned) + 1) {
+                                /* truncated towards zero, out of range values are undefined */
+                                set_int(m, n, n->f < 0 ? (uint64_t) (int64_t) n->f : (uint64_t) n->f, rank, is_unsigned);
+                        } else {
+                                undefined_value(m);
+                                set_int(m, n, 0, rank, is_unsigned);
+                        }
+                } else {
+                        eval_conditional(m, n);
+                        if (!accept_punct(m, ")"))
+                                m->failed = true;
+                }
+        } else if (kind == CXToken_Literal) {
+                m->pos++;
+                if (!parse_literal(m, s, n))
+                        m->failed = true;
+        } else if (kind == CXToken_Identifier) {
+                m->pos++;
+                lua_getfield(m->L, m->types, s);
+                lua_getfield(m->L, m->known, s);
+                if (lua_isinteger(m->L, -2)) {
+                        lua_Integer code = lua_tointeger(m->L, -2);
+                        set_int(m, n, (uint64_t) lua_tointeger(m->L, -1), (enum macro_rank) (code / 2), code % 2);
+                } else if (lua_type(m->L, -1) == LUA_TNUMBER) {
+                        n->is_float = true;
+                        n->f = lua_tonumber(m->L, -1);
+                } else {
+                        m->failed = true;
+                }
+                lua_pop(m->L, 2);
+        } else {
+                m->failed = true;
+        }
+}
+
+/* Precedence climbing over binary_ops */
+static void eval_binary(macro_eval *m, macro_number *n, int min_precedence)
+{
+        eval_unary(m, n);
+        while (!m->failed && m->pos < m->count &&
+               clang_getTokenKind(m->tokens[m->pos]) == CXToken_Punctuation) {
+                const char *s = token_spelling(m, m->pos);
+                int i;
+                for (i = 0; binary_ops[i].op != NULL; i++) {
+                        if (strcmp(binary_ops[i].op, s) == 0)
+                                break;
+                }
+                if (binary_ops[i].op == NULL || binary_ops[i].precedence < min_precedence)
+                        return;
+                m->pos++;
+                macro_number rhs;
+                if (strcmp(s, "&&") == 0 || strcmp(s, "||") == 0) {
+                        /* the right operand isn't evaluated once the left one decides */
+                        bool lhs = is_true(n);
+                        bool decided = s[0] == '&' ? !lhs : lhs;
+                        m->skipping += decided;
+                        eval_binary(m, &rhs, binary_ops[i].precedence + 1);
+                        m->skipping -= decided;
+                        set_bool(m, n, decided ? lhs : is_true(&rhs));
+                        continue;
+                }
+                eval_binary(m, &rhs, binary_ops[i].precedence + 1);
+                if (!m->failed && !apply_binary(m, binary_ops[i].op, n, rhs)) {
+                        undefined_value(m);
+                        set_bool(m, n, false);
+                }
+        }
+}
+
+static void eval_conditional(macro_eval *m, macro_number *n)
+{
+        eval_binary(m, n, 1);
+        if (!m->failed && accept_punct(m, "?")) {
+                bool condition = is_true(n);
+                macro_number a, b;
+                m->skipping += !condition;
+                eval_conditional(m, &a);
+                m->skipping -= !condition;
+                if (!accept_punct(m, ":"))
+                        m->failed = true;
+                m->skipping += condition;
+                eval_conditional(m, &b);
+                m->skipping -= condition;
+                if (!m->failed) {
+                        /* the result has the common type of both operands */
+                        convert_operands(m, &a, &b);
+                        *n = condition ? a : b;
+                }
+        }
+}
+
+/* Push the concatenation of the string literals of 'm', return false if there are other tokens */
+static bool push_macro_string(macro_eval *m)
+{
+        for (unsigned i = 1; i < m->count; i++) {
+                const char *s = token_spelling(m, i);
+                if (strncmp(s, "u8", 2) == 0)
+                        s += 2;
+                if (clang_getTokenKind(m->tokens[i]) != CXToken_Literal || s[0] != '"')
+                        return false;
+        }
+        luaL_Buffer b;
+        luaL_buffinit(m->L, &b);
+        for (unsigned i = 1; i < m->count; i++) {
+                const char *s = strchr(token_spelling(m, i), '"') + 1;
+                const char *end = s + strlen(s) - 1;
+                while (s < end)
+                        luaL_addchar(&b, (char) decode_char(&s));
+        }
+        luaL_pushresult(&b);
+        return true;
+}
+
+/*
+        Evaluate the object-like macro 'cursor', recording it in the tables of 'm' and, unless 'values'
+        is 0, in the table at 'values'. Return false if it isn't resolved, ie. it isn't a numeric or
+        string constant, or it refers to macros which aren't evaluated yet.
+*/
+static bool eval_macro(macro_eval *m, CXTranslationUnit tu, CXCursor cursor, int values)
+{
+        lua_State *L = m->L;
+        m->tokens = NULL;
+        m->count = 0;
+        m->pos = 1;
+        m->skipping = 0;
+        m->failed = false;
+        clang_tokenize(tu, clang_getCursorExtent(cursor), &m->tokens, &m->count);
+        if (m->count < 2) {
+                clang_disposeTokens(tu, m->tokens, m->count);
+                return false;
+        }
+        m->spellings = (CXString *) malloc(m->count * sizeof(CXString));
+        if (m->spellings == NULL) {
+                clang_disposeTokens(tu, m->tokens, m->count);
+                return false;
+        }
+        for (unsigned i = 0; i < m->count; i++)
+                m->spellings[i] = clang_getTokenSpelling(tu, m->tokens[i]);
+        bool resolved = false;
+        const char *name = token_spelling(m, 0);
+        const char *first = token_spelling(m, 1);
+        luaL_checkstack(L, 8, NULL);
+        if (m->count == 2 && clang_getTokenKind(m->tokens[1]) == CXToken_Identifier) {
+                /* alias of another macro, whatever its value */
+                resolved = lua_getfield(L, m->known, first) != LUA_TNIL;
+                if (resolved) {
+                        lua_setfield(L, m->known, name);
+                        lua_getfield(L, m->types, first);
+                        lua_setfield(L, m->types, name);
+                } else {
+                        lua_pop(L, 1);
+                }
+        } else if (strchr(first, '"') != NULL) {
+                resolved = push_macro_string(m);
+                if (resolved)
+                        lua_setfield(L, m->known, name);
+        } else {
+                macro_number n;
+                eval_conditional(m, &n);
+                resolved = !m->failed && m->pos == m->count;
+                if (resolved && n.is_float) {
+                        lua_pushnumber(L, n.f);
+                        lua_setfield(L, m->known, name);
+                } else if (resolved) {
+                        lua_pushinteger(L, (lua_Integer) n.bits);
+                        lua_setfield(L, m->known, name);
+                        lua_pushinteger(L, n.rank * 2 + n.is_unsigned);
+                        lua_setfield(L, m->types, name);
+                }
+        }
+        if (resolved && values != 0) {
+                lua_getfield(L, m->types, name);
+                lua_getfield(L, m->known, name);
+                /* unsigned values beyond the range of the Lua integers are left out */
+                if (lua_isinteger(L, -2) && lua_tointeger(L, -2) % 2 == 1 && lua_tointeger(L, -1) < 0)
+                        lua_pop(L, 1);
+                else
+                        lua_setfield(L, values, name);
+                lua_pop(L, 1);
+        }
+        for (unsigned i = 0; i < m->count; i++)
+                clang_disposeString(m->spellings[i]);
+        free(m->spellings);
+        clang_disposeTokens(tu, m->tokens, m->count);
+        return resolved;
+}
+
+/* Object-like macro definition, evaluated even if it isn't returned as other macros may refer to it */
+typedef struct macro_entry {
+        CXCursor cursor;
+        bool selected;          /* passes the filter, and isn't predefined by the compiler */
+} macro_entry;
+
+/* Object-like macro definitions collected from the translation unit */
+typedef struct macro_list {
+        CXTranslationUnit tu;
+        macro_entry *entries;
+        unsigned count;
+        unsigned capacity;
+        const cursor_filter *filter;    /* NULL if every file is accepted */
+        macro_target target;
+        unsigned long long visited;
+        bool failed;                    /* out of memory */
+} macro_list;
+
+/* Read the sizes of the integer types from the macro 'cursor' predefined by the compiler */
+static void read_target_macro(macro_list *list, CXCursor cursor)
+{
+        static const struct {
+                const char *name;
+                enum macro_rank rank;
+        } sizes[] = {
+                {"__SIZEOF_SHORT__", RANK_SHORT}, {"__SIZEOF_INT__", RANK_INT},
+                {"__SIZEOF_LONG__", RANK_LONG}, {"__SIZEOF_LONG_LONG__", RANK_LLONG}, {NULL, 0}
+        };
+        CXString spelling = clang_getCursorSpelling(cursor);
+        const char *name = clang_getCString(spelling);
+        if (strcmp(name, "__CHAR_UNSIGNED__") == 0)
+                list->target.char_unsigned = true;
+        for (int i = 0; sizes[i].name != NULL; i++) {
+                if (strcmp(name, sizes[i].name) != 0)
+                        continue;
+                CXToken *tokens;
+                unsigned count;
+                clang_tokenize(list->tu, clang_getCursorExtent(cursor), &tokens, &count);
+                if (count == 2) {
+                        CXString size = clang_getTokenSpelling(list->tu, tokens[1]);
+                        long bytes = strtol(clang_getCString(size), NULL, 10);
+                        if (bytes > 0 && bytes <= 8)
+                                list->target.width[sizes[i].rank] = (int) bytes * CHAR_BIT;
+                        clang_disposeString(size);
+                }
+                clang_disposeTokens(list->tu, tokens, count);
+        }
+        clang_disposeString(spelling);
+}
+
+static enum CXChildVisitResult macro_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        macro_list *list = (macro_list *) client_data;
+        list->visited++;
+        if (clang_getCursorKind(cursor) != CXCursor_MacroDefinition || clang_Cursor_isMacroBuiltin(cursor) ||
+            clang_Cursor_isMacroFunctionLike(cursor))
+                return CXChildVisit_Continue;
+        CXFile file;
+        clang_getExpansionLocation(clang_getCursorLocation(cursor), &file, NULL, NULL, NULL);
+        if (file == NULL)       /* predefined by the compiler */
+                read_target_macro(list, cursor);
+        if (list->count == list->capacity) {
+                unsigned capacity = list->capacity ? list->capacity * 2 : 64;
+                macro_entry *entries = realloc(list->entries, capacity * sizeof(macro_entry));
+                if (entries == NULL) {
+                        list->failed = true;
+                        return CXChildVisit_Break;
+                }
+                list->entries = entries;
+                list->capacity = capacity;
+        }
+        macro_entry *entry = &list->entries[list->count++];
+        entry->cursor = cursor;
+        entry->selected = file != NULL && (list->filter == NULL || filter_accepts(list->filter, cursor));
+        return CXChildVisit_Continue;
+}
+
+/*
+        Format - parser:getMacros([options])
+        Parameters - parser - Clang object whose macro definitions are to be evaluated
+                   - options - Optional table with the filter options mainFileOnly, skipSystemHeaders
+                               and files, as accepted by cur:visitChildren()
+        The translation unit has to be parsed with the detailedPreprocessingRecord option, else
+        no macro definition is seen. Object-like macros are evaluated in C from their tokens :
+        numeric and character literals, string literals (adjacent ones are concatenated), casts
+        to arithmetic types, the C arithmetic, bitwise, comparison, logical and conditional
+        operators, and references to other evaluated macros. Integers keep the type C gives
+        them, from the literal suffixes and the casts, with the sizes of the target : unsigned
+        arithmetic wraps around and casts truncate. The operands which C doesn't evaluate, eg.
+        the other branch of ?:, may have undefined values. Function-like macros, macros
+        predefined by the compiler and macros which aren't constants are left out, so are the
+        unsigned values which don't fit a Lua integer. The macros of every file, and those
+        predefined by the compiler, are evaluated so that the returned ones may refer to them,
+        the filter only selects the macros returned.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__LEX.html
+        Returns a table mapping the name of each evaluated macro to its value
+*/
+static int parser_getmacros(lua_State *L)
+{
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 1);
+        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
+        cursor_filter filter;
+        macro_list list = {parser->tu, NULL, 0, 0, NULL, {{0}, CHAR_MIN == 0}, 0, false};
+        /* sizes of the host, unless the compiler predefines those of the target */
+        list.target.width[RANK_BOOL] = list.target.width[RANK_CHAR] = CHAR_BIT;
+        list.target.width[RANK_SHORT] = (int) sizeof(short) * CHAR_BIT;
+        list.target.width[RANK_INT] = (int) sizeof(int) * CHAR_BIT;
+        list.target.width[RANK_LONG] = (int) sizeof(long) * CHAR_BIT;
+        list.target.width[RANK_LLONG] = (int) sizeof(long long) * CHAR_BIT;
+        if (!lua_isnoneornil(L, 2)) {
+                luaL_checktype(L, 2, LUA_TTABLE);
+                check_cursor_filter(L, 2, parser->tu, &filter);
+                list.filter = &filter;
+        }
+        clang_visitChildren(clang_getTranslationUnitCursor(parser->tu), macro_visitor, &list);
+        if (list.filter != NULL)
+                free(filter.files);
+        parser->stats.cursors_visited += list.visited;
+        if (list.failed) {
+                free(list.entries);
+                return luaL_error(L, "not enough memory");
+        }
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_newtable(L);
+        macro_eval m = {L, lua_gettop(L) - 2, lua_gettop(L) - 1, &list.target, NULL, NULL, 0, 1, 0, false};
+        int values = lua_gettop(L);
+        /* a macro may refer to macros defined after it, retry those until nothing changes */
+        bool progress = true;
+        while (progress && list.count > 0) {
+                progress = false;
+                unsigned pending = 0;
+                for (unsigned i = 0; i < list.count; i++) {
+                        const macro_entry *entry = &list.entries[i];
+                        if (eval_macro(&m, parser->tu, entry->cursor, entry->selected ? values : 0))
+                                progress = true;
+                        else
+                                list.entries[pending++] = *entry;
+                }
+                list.count = pending;
+        }
+        free(list.entries);
+        return 1;
+}
+
+/* --Declaration index-- */
+
+/* Declarations collected by index_visitor, before they are hashed */
+typedef struct index_builder {
+        decl_entry *decls;
+        unsigned count;
+        unsigned capacity;
+        strbuf strings;
+        unsigned long long visited;
+        bool failed;            /* out of memory */
+} index_builder;
+
+static bool is_function_decl(enum CXCursorKind kind)
+{
+        switch (kind) {
+                case CXCursor_FunctionDecl:
+                case CXCursor_CXXMethod:
+                case CXCursor_Constructor:
+                case CXCursor_Destructor:
+                case CXCursor_ConversionFunction:
+                case CXCursor_FunctionTemplate:
+                case CXCursor_ObjCInstanceMethodDecl:
+                case CXCursor_ObjCClassMethodDecl:
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+/* Append 'str' and its terminating zero to 'buf', return its offset */
+static size_t strbuf_addkey(strbuf *buf, CXString str)
+{
+        size_t offset = buf->len;
+        strbuf_addcxstring(buf, str);
+        strbuf_insert(buf, buf->len, "", 1);
+        return offset;
+}
+
+/* Collect the declarations, without descending into function bodies */
+static enum CXChildVisitResult index_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        index_builder *b = (index_builder *) client_data;
+        enum CXCursorKind kind = clang_getCursorKind(cursor);
+        b->visited++;
+        if (!clang_isDeclaration(kind))
+                return CXChildVisit_Continue;
+        if (b->count == b->capacity) {
+                unsigned capacity = b->capacity ? b->capacity * 2 : 256;
+                decl_entry *decls = (decl_entry *) realloc(b->decls, capacity * sizeof(decl_entry));
+                if (decls == NULL) {
+                        b->failed = true;
+                        return CXChildVisit_Break;
+                }
+                b->decls = decls;
+                b->capacity = capacity;
+        }
+        decl_entry *entry = &b->decls[b->count++];
+        entry->cursor = cursor;
+        entry->name = strbuf_addkey(&b->strings, clang_getCursorSpelling(cursor));
+        entry->usr = strbuf_addkey(&b->strings, clang_getCursorUSR(cursor));
+        entry->next_name = 0;
+        entry->merged = false;
+        if (b->strings.failed) {
+                b->failed = true;
+                return CXChildVisit_Break;
+        }
+        return is_function_decl(kind) ? CXChildVisit_Continue : CXChildVisit_Recurse;
+}
+
+static unsigned key_hash(const char *key)
+{
+        return (unsigned) fnv1a(FNV_OFFSET, key, strlen(key));
+}
+
+/* Return the key of the element 'id' of 'owner' */
+typedef const char *(*key_fn)(const void *owner, unsigned id);
+
+/* Return the slot of 'key' in the open addressing table 'slots', either free or holding the id with that key */
+static unsigned key_slot(const unsigned *slots, unsigned num_slots, const char *key, key_fn fn, const void *owner)
+{
+        unsigned mask = num_slots - 1;
+        unsigned i = key_hash(key) & mask;
+        while (slots[i] != 0 && strcmp(fn(owner, slots[i]), key) != 0)
+                i = (i + 1) & mask;
+        return i;
+}
+
+static const char *decl_usr(const void *owner, unsigned id)
 {
-        CXCursor *cur;
-        new_object(L, cur, CURSOR_METATABLE);
-        *cur = clang_getNullCursor();
-        return 1;
+        const decl_index *index = (const decl_index *) owner;
+        return index->strings + index->decls[id - 1].usr;
 }
 
-/* --Parser functions-- */
+static const char *decl_name(const void *owner, unsigned id)
+{
+        const decl_index *index = (const decl_index *) owner;
+        return index->strings + index->decls[id - 1].name;
+}
 
-/*      
-        Format - parser:dispose()
-        Parameter - parser - Clang object to be disposed
-        More info - 1. https://clang.llvm.org/doxygen/group__CINDEX.html#ga51eb9b38c18743bf2d824c6230e61f93
-                    2. https://clang.llvm.org/doxygen/group__CINDEX__TRANSLATION__UNIT.html#ga2baf83f8c3299788234c8bce55e4472e
-        Returns nothing
-*/
-static int parser_dispose(lua_State *L)
+/* Return the slot of 'key' in 'slots', which is either free or holds a declaration with that key */
+static unsigned find_slot(const decl_index *index, const unsigned *slots, const char *key, bool by_usr)
 {
-        clang_parser *parser;
-        to_object(L, parser, PARSER_METATABLE, 1);
-        if (parser->idx == NULL) return 0;
-        clang_disposeIndex(parser->idx);
-        clang_disposeTranslationUnit(parser->tu);
-        parser->idx = NULL;
-        parser->tu = NULL;
-        return 0;
+        return key_slot(slots, index->num_slots, key, by_usr ? decl_usr : decl_name, index);
 }
 
-/*      
-        Format - parser:getCursor()
-        Parameter - parser - Clang object whose translation unit cursor is to be obtained 
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#gaec6e69127920785e74e4a517423f4391
-        Returns translation unit cursor
+/*
+        Hash the declarations of 'b' by USR and by name. Declarations with the USR of an
+        earlier one are merged into it, the definition being kept if there is one.
 */
-static int parser_getcursor(lua_State *L) 
+static decl_index *hash_declarations(index_builder *b)
 {
-        clang_parser *parser;
-        to_object(L, parser, PARSER_METATABLE, 1);
-        luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
-        CXCursor *cur;
-        new_object(L, cur, CURSOR_METATABLE);
-        *cur = clang_getTranslationUnitCursor(parser->tu);
-        if (clang_Cursor_isNull(*cur)) {
-                lua_pushnil(L);
+        decl_index *index = (decl_index *) malloc(sizeof(decl_index));
+        if (index == NULL)
+                return NULL;
+        index->decls = b->decls;
+        index->count = b->count;
+        index->strings = b->strings.data;
+        index->num_slots = 16;
+        while (index->num_slots < 2 * b->count)
+                index->num_slots *= 2;
+        index->usr_slots = (unsigned *) calloc(index->num_slots, sizeof(unsigned));
+        index->name_slots = (unsigned *) calloc(index->num_slots, sizeof(unsigned));
+        if (index->usr_slots == NULL || index->name_slots == NULL) {
+                free(index->usr_slots);
+                free(index->name_slots);
+                free(index);
+                return NULL;
         }
-        return 1;
+        for (unsigned id = 1; id <= index->count; id++) {
+                decl_entry *entry = &index->decls[id - 1];
+                const char *usr = index->strings + entry->usr;
+                if (usr[0] == '\0')
+                        continue;
+                unsigned i = find_slot(index, index->usr_slots, usr, true);
+                if (index->usr_slots[i] == 0) {
+                        index->usr_slots[i] = id;
+                        continue;
+                }
+                decl_entry *first = &index->decls[index->usr_slots[i] - 1];
+                if (!clang_isCursorDefinition(first->cursor) && clang_isCursorDefinition(entry->cursor))
+                        first->cursor = entry->cursor;
+                entry->merged = true;
+        }
+        /* chain the declarations of each name in traversal order */
+        for (unsigned id = index->count; id >= 1; id--) {
+                decl_entry *entry = &index->decls[id - 1];
+                const char *name = index->strings + entry->name;
+                if (entry->merged || name[0] == '\0')
+                        continue;
+                unsigned i = find_slot(index, index->name_slots, name, false);
+                entry->next_name = index->name_slots[i];
+                index->name_slots[i] = id;
+        }
+        return index;
 }
 
-/*      
-        Format - parser:getNumDiagnostics()
-        Parameter - parser - Clang object whose translation unit is to be diagnosed 
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#gae9f047b4bbbbb01161478d549b7aab25
-        Returns the number of diagnostics produced for the given translation unit 
+/* Index the declarations of 'parser', raise an error if out of memory */
+static void build_decl_index(lua_State *L, clang_parser *parser)
+{
+        index_builder b = {NULL, 0, 0, {NULL, 0, 0, false}, 0, false};
+        free_decl_index(parser);
+        clang_visitChildren(clang_getTranslationUnitCursor(parser->tu), index_visitor, &b);
+        parser->stats.cursors_visited += b.visited;
+        if (!b.failed && b.strings.data == NULL)
+                strbuf_insert(&b.strings, 0, "", 1);
+        if (!b.failed && !b.strings.failed)
+                parser->decls = hash_declarations(&b);
+        if (parser->decls == NULL) {
+                free(b.decls);
+                free(b.strings.data);
+                luaL_error(L, "not enough memory");
+        }
+}
+
+/*
+        Format - parser:buildIndex()
+        Parameter - parser - Clang object whose declarations are to be indexed
+        Hash tables over the top-level and nested declarations (function bodies excepted) are
+        built in a single pass, after which parser:findDecl() and parser:findByUSR() don't
+        touch the AST anymore. Declarations sharing a USR, like a forward declaration and the
+        definition of a struct, are merged into the definition. The index is built on the first
+        lookup if needed, and dropped when the parser is reparsed.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html
+        Returns the number of distinct declarations
 */
-static int parser_getnumdiagnostics(lua_State *L)
+static int parser_buildindex(lua_State *L)
 {
         clang_parser *parser;
         to_object(L, parser, PARSER_METATABLE, 1);
         luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
-        unsigned int num_diags = clang_getNumDiagnostics(parser->tu);
-        lua_pushinteger(L, num_diags);
+        build_decl_index(L, parser);
+        unsigned count = 0;
+        for (unsigned i = 0; i < parser->decls->count; i++)
+                count += !parser->decls->decls[i].merged;
+        lua_pushinteger(L, count);
         return 1;
 }
 
-/*      
-        Format - parser:getDiagnostic(idx)
-        Parameters - parser - Clang object whose translation unit is to be diagnosed 
-                   - idx    - Index of the specific diagnostic
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#ga3f54a79e820c2ac9388611e98029afe5
-                  - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#gabfcf70ac15bb3e5ae39ef2c5e07c7428
-                  - https://clang.llvm.org/doxygen/group__CINDEX__LOCATIONS.html#ga01f1a342f7807ea742aedd2c61c46fa0
-                  - https://clang.llvm.org/doxygen/group__CINDEX__DIAG.html#ga455234ab6de0ca12c9ea36f8874060e8
-        Returns - 1. Line number 
-                  2. Column number
-                  3. Diagnostic message 
-*/
-static int parser_getdiagnostic(lua_State *L)
+static decl_index *check_decl_index(lua_State *L)
 {
         clang_parser *parser;
         to_object(L, parser, PARSER_METATABLE, 1);
         luaL_argcheck(L, parser->tu != NULL, 1, "parser object was disposed");
-        unsigned int index = luaL_checkinteger(L, 2);
-        luaL_argcheck(L, index <= clang_getNumDiagnostics(parser->tu), 1, "argument index out of bounds");
-        CXDiagnostic diag = clang_getDiagnostic(parser->tu, index-1);
-        CXSourceLocation location = clang_getDiagnosticLocation(diag);
-        unsigned int line, column;
-        clang_getSpellingLocation(location, NULL, &line, &column, NULL);
-        CXString err_str = clang_formatDiagnostic(diag, 0);
-        lua_pushinteger(L, line);
-        lua_pushinteger(L, column);
-        lua_pushstring(L, clang_getCString(err_str));
-        clang_disposeDiagnostic(diag);
-        clang_disposeString(err_str);
-        return 3;  
+        if (parser->decls == NULL)
+                build_decl_index(L, parser);
+        return parser->decls;
 }
 
-/* --Cursor functions-- */
+/*
+        Format - parser:findDecl(name [, kind])
+        Parameters - parser - Clang object whose declarations are searched, see parser:buildIndex()
+                   - name - Spelling of the declaration, eg. "foo" for struct foo
+                   - kind - Optional cursor kind name or id (see cur:getKind(), cur:getKindId()) the declaration must have
+        Returns the first declaration in traversal order with the given name and kind, or nil
+*/
+static int parser_finddecl(lua_State *L)
+{
+        decl_index *index = check_decl_index(L);
+        const char *name = luaL_checkstring(L, 2);
+        int kind = opt_cursor_kind(L, 3);
+        unsigned id = index->name_slots[find_slot(index, index->name_slots, name, false)];
+        for (; id != 0; id = index->decls[id - 1].next_name) {
+                CXCursor cursor = index->decls[id - 1].cursor;
+                if (kind == -1 || (int) clang_getCursorKind(cursor) == kind) {
+                        push_cursor(L, cursor);
+                        return 1;
+                }
+        }
+        lua_pushnil(L);
+        return 1;
+}
 
-/*      
-        Format - cur:getSpelling()
-        Parameter - cur - Cursor whose name is to be obtained    
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html#gaad1c9b2a1c5ef96cebdbc62f1671c763
-	Returns the name(spelling) of the entity represented by the cursor
+/*
+        Format - parser:findByUSR(usr)
+        Parameters - parser - Clang object whose declarations are searched, see parser:buildIndex()
+                   - usr - Unified Symbol Resolution of the declaration, as returned by cur:getUSR()
+        Returns the declaration with the given USR, its definition if there is one, or nil
 */
-static int cursor_getspelling(lua_State *L) 
+static int parser_findbyusr(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        CXString name = clang_getCursorSpelling(*cur);
-        lua_pushstring(L, clang_getCString(name));
-        clang_disposeString(name);
+        decl_index *index = check_decl_index(L);
+        const char *usr = luaL_checkstring(L, 2);
+        unsigned id = usr[0] != '\0' ? index->usr_slots[find_slot(index, index->usr_slots, usr, true)] : 0;
+        if (id == 0)
+                lua_pushnil(L);
+        else
+                push_cursor(L, index->decls[id - 1].cursor);
         return 1;
 }
 
-/* Return the cursor kind as a string */
-static const char *cursor_kind_str(enum CXCursorKind kind) 
+/* --Declaration database-- */
+
+/* Open addressing table of ids keyed by strings, see key_slot() */
+typedef struct key_table {
+        unsigned *slots;        /* ids, 0 if free */
+        unsigned num_slots;     /* power of two, at least twice 'count', or 0 */
+        unsigned count;
+} key_table;
+
+/* Return the id of 'key' in 't', 0 if it isn't there */
+static unsigned key_table_find(const key_table *t, const char *key, key_fn fn, const void *owner)
 {
-        switch (kind) {
-                case CXCursor_StructDecl: 
-                        return "StructDecl";
-                case CXCursor_UnionDecl: 
-                        return "UnionDecl";
-                case CXCursor_EnumDecl: 
-                        return "EnumDecl";
-                case CXCursor_FieldDecl: 
-                        return "FieldDecl";
-                case CXCursor_EnumConstantDecl: 
-                        return "EnumConstantDecl";
-                case CXCursor_FunctionDecl: 
-                        return "FunctionDecl";
-                case CXCursor_VarDecl: 
-                        return "VarDecl";
-                case CXCursor_ParmDecl: 
-                        return "ParmDecl";
-                case CXCursor_TypedefDecl: 
-                        return "TypedefDecl";
-                case CXCursor_IntegerLiteral: 
-                        return "IntegerLiteral";
-                default: 
-                        return "Unaddressed";
+        if (t->num_slots == 0)
+                return 0;
+        return t->slots[key_slot(t->slots, t->num_slots, key, fn, owner)];
+}
+
+/* Make room in 't' for one more id, return false if out of memory */
+static bool key_table_reserve(key_table *t, key_fn fn, const void *owner)
+{
+        if (2 * (t->count + 1) > t->num_slots) {
+                unsigned num_slots = t->num_slots ? t->num_slots * 2 : 64;
+                unsigned *slots = (unsigned *) calloc(num_slots, sizeof(unsigned));
+                if (slots == NULL)
+                        return false;
+                for (unsigned i = 0; i < t->num_slots; i++) {
+                        if (t->slots[i] != 0)
+                                slots[key_slot(slots, num_slots, fn(owner, t->slots[i]), fn, owner)] = t->slots[i];
+                }
+                free(t->slots);
+                t->slots = slots;
+                t->num_slots = num_slots;
         }
+        return true;
 }
 
-/*      
-        Format - cur:getKind()
-        Parameter - cur - Cursor whose kind is to be obtained    
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga018aaf60362cb751e517d9f8620d490c
-*/
-static int cursor_getkind(lua_State *L)
+/* Add 'id', whose key isn't in 't' yet, after key_table_reserve() */
+static void key_table_insert(key_table *t, unsigned id, key_fn fn, const void *owner)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        lua_pushstring(L, cursor_kind_str(clang_getCursorKind(*cur)));
-        return 1;
+        t->slots[key_slot(t->slots, t->num_slots, fn(owner, id), fn, owner)] = id;
+        t->count++;
 }
 
-/*
-        Format - cur:getType()
-        Parameter - cur - Cursor whose type is to be obtained    
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#gaae5702661bb1f2f93038051737de20f4
-        Returns the type of the cursor
-*/
-static int cursor_gettype(lua_State *L)
+/* Declaration merged from any number of translation units, its strings are ids in decl_db */
+typedef struct decl_record {
+        unsigned name;
+        unsigned usr;
+        unsigned file;
+        unsigned type;
+        unsigned line;
+        unsigned column;
+        enum CXCursorKind kind;
+        bool is_definition;
+        unsigned next_name;     /* id of the next record with the same name, 0 if none */
+        unsigned last_name;     /* in the first record of a name, id of the last record with that name */
+} decl_record;
+
+typedef struct decl_db {
+        decl_record *records;   /* the id of a record is its position plus one */
+        unsigned count;
+        unsigned capacity;
+        strbuf strings;         /* interned strings, zero terminated */
+        size_t *offsets;        /* offset of each string in 'strings', by id minus one */
+        unsigned num_strings;
+        unsigned strings_capacity;
+        key_table string_ids;
+        key_table usr_ids;
+        key_table name_ids;     /* first record of each name */
+        unsigned long long ingested;    /* declarations seen, duplicates included */
+        bool disposed;
+} decl_db;
+
+static const char *db_string(const void *owner, unsigned id)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        CXType *cur_type;
-        new_object(L, cur_type, TYPE_METATABLE);
-        *cur_type = clang_getCursorType(*cur);
-        return 1;
+        const decl_db *db = (const decl_db *) owner;
+        return db->strings.data + db->offsets[id - 1];
 }
 
-/*      
-        Format - cur:getNumArgs()
-        Parameter - cur - Cursor which represents a function
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga5254f761b57fd78de3ac9c6bfcaa7fed
-        Returns the number of non-variadic arguments in the function is to be obtained
-*/
-static int cursor_getnumargs(lua_State *L)
+static const char *db_record_usr(const void *owner, unsigned id)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FunctionDecl, 1, "expect cursor with function kind");
-        int num_args = clang_Cursor_getNumArguments(*cur);
-        lua_pushnumber(L, num_args);
-        return 1;
+        const decl_db *db = (const decl_db *) owner;
+        return db_string(db, db->records[id - 1].usr);
 }
 
-/*
-        Format - cur:getArgCursor(idx)
-        Parameters - cur - Cursor representing the function declaration 
-                   - idx - parameter index (starting from 1)
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga673c5529d33eedd0b78aca5ac6fc1d7c
-        Returns the cursor of the parameter at index 'idx' in the function 
-*/
-static int cursor_getarg(lua_State *L)
+static const char *db_record_name(const void *owner, unsigned id)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FunctionDecl, 1, "expect cursor with function kind");
-        unsigned int index = luaL_checkinteger(L, 2);
-        luaL_argcheck(L, index <= clang_Cursor_getNumArguments(*cur), 1, "argument index out of bounds");
-        CXCursor *arg_cur;
-        new_object(L, arg_cur, CURSOR_METATABLE);
-        *arg_cur = clang_Cursor_getArgument(*cur, index-1);
-        return 1;
+        const decl_db *db = (const decl_db *) owner;
+        return db_string(db, db->records[id - 1].name);
 }
 
-/*      
-        Format - cur:isFunctionInline()
-        Parameter - cur - Cursor which is to be checked (whether the FunctionDecl 'cur' represents is inline)
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga5254f761b57fd78de3ac9c6bfcaa7fed
-        Returns 'true' if the function is inlined , 'false' otherwise
-*/
-static int cursor_isinlined(lua_State *L)
+/* Return the id of 'str', interning it if needed, 0 if out of memory */
+static unsigned db_intern(decl_db *db, const char *str)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FunctionDecl, 1, "expect cursor with function kind");
-        CINDEX_LINKAGE bool is_inline;
-        is_inline = clang_Cursor_isFunctionInlined(*cur);
-        lua_pushboolean(L, is_inline);
-        return 1;
+        unsigned id = key_table_find(&db->string_ids, str, db_string, db);
+        if (id != 0)
+                return id;
+        if (!key_table_reserve(&db->string_ids, db_string, db))
+                return 0;
+        if (db->num_strings == db->strings_capacity) {
+                unsigned capacity = db->strings_capacity ? db->strings_capacity * 2 : 256;
+                size_t *offsets = (size_t *) realloc(db->offsets, capacity * sizeof(size_t));
+                if (offsets == NULL)
+                        return 0;
+                db->offsets = offsets;
+                db->strings_capacity = capacity;
+        }
+        size_t offset = db->strings.len;
+        strbuf_addstr(&db->strings, str);
+        strbuf_insert(&db->strings, db->strings.len, "", 1);
+        if (db->strings.failed)
+                return 0;
+        db->offsets[db->num_strings] = offset;
+        id = ++db->num_strings;
+        key_table_insert(&db->string_ids, id, db_string, db);
+        return id;
 }
 
-/*      
-        Format - cur:getEnumValue()
-        Parameter - cur - Cursor which represents an EnumConstantDecl whose integer value is to be obtained
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga6b8585818420e7512feb4c9d209b4f4d
-        Returns the integer value corresponding to the EnumConstantDecl
-*/
-static int cursor_getenumvalue(lua_State *L)
+/* Intern the CXString 'str' and dispose it */
+static unsigned db_intern_cxstring(decl_db *db, CXString str)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_EnumConstantDecl, 1, "expect cursor with enum constant kind");
-        int enum_value = clang_getEnumConstantDeclValue(*cur);
-        lua_pushinteger(L, enum_value);
-        return 1;
+        unsigned id = db_intern(db, clang_getCString(str));
+        clang_disposeString(str);
+        return id;
 }
 
-/* Retrieve the storage class specifier string */
-static const char *storage_class_str(enum CX_StorageClass sc_specifier) 
+/* Set the location, type and definition of 'record' from 'cursor', return false if out of memory */
+static bool db_describe(decl_db *db, decl_record *record, CXCursor cursor)
 {
-        switch (sc_specifier) {
-                case CX_SC_Invalid:
-                        return "invalid";
-                case CX_SC_None:
-                        return "none";
-                case CX_SC_Extern:
-                        return "extern";
-                case CX_SC_Static:
-                        return "static";
-                case CX_SC_PrivateExtern:
-                        return "private extern";
-                case CX_SC_OpenCLWorkGroupLocal:
-                        return "opencl workgroup local";
-                case CX_SC_Auto:
-                        return "auto";
-                case CX_SC_Register:
-                        return "register";
-                default:
-                        return NULL;
+        CXFile file;
+        clang_getSpellingLocation(clang_getCursorLocation(cursor), &file, &record->line, &record->column, NULL);
+        record->file = file != NULL ? db_intern_cxstring(db, clang_getFileName(file)) : db_intern(db, "");
+        record->type = db_intern_cxstring(db, clang_getTypeSpelling(clang_getCursorType(cursor)));
+        record->is_definition = clang_isCursorDefinition(cursor);
+        return record->file != 0 && record->type != 0;
+}
+
+/* Add a record for 'cursor' whose USR isn't known yet, return false if out of memory */
+static bool db_add(decl_db *db, CXCursor cursor, const char *usr)
+{
+        if (db->count == db->capacity) {
+                unsigned capacity = db->capacity ? db->capacity * 2 : 256;
+                decl_record *records = (decl_record *) realloc(db->records, capacity * sizeof(decl_record));
+                if (records == NULL)
+                        return false;
+                db->records = records;
+                db->capacity = capacity;
+        }
+        decl_record *record = &db->records[db->count];
+        record->kind = clang_getCursorKind(cursor);
+        record->next_name = 0;
+        record->last_name = 0;
+        record->usr = db_intern(db, usr);
+        record->name = db_intern_cxstring(db, clang_getCursorSpelling(cursor));
+        if (record->usr == 0 || record->name == 0 || !db_describe(db, record, cursor))
+                return false;
+        /* the record only counts once both tables are sure to accept it */
+        unsigned id = db->count + 1;
+        unsigned first = key_table_find(&db->name_ids, db_string(db, record->name), db_record_name, db);
+        if (!key_table_reserve(&db->usr_ids, db_record_usr, db) ||
+            (first == 0 && !key_table_reserve(&db->name_ids, db_record_name, db)))
+                return false;
+        key_table_insert(&db->usr_ids, id, db_record_usr, db);
+        if (first == 0) {
+                key_table_insert(&db->name_ids, id, db_record_name, db);
+                record->last_name = id;
+        } else {
+                db->records[db->records[first - 1].last_name - 1].next_name = id;
+                db->records[first - 1].last_name = id;
+        }
+        db->count = id;
+        return true;
+}
+
+typedef struct ingest_state {
+        decl_db *db;
+        unsigned added;
+        unsigned long long visited;
+        bool failed;            /* out of memory */
+} ingest_state;
+
+/* Merge the declarations into the database, without descending into function bodies */
+static enum CXChildVisitResult ingest_visitor(CXCursor cursor, CXCursor parent, CXClientData client_data)
+{
+        ingest_state *state = (ingest_state *) client_data;
+        decl_db *db = state->db;
+        enum CXCursorKind kind = clang_getCursorKind(cursor);
+        state->visited++;
+        if (!clang_isDeclaration(kind))
+                return CXChildVisit_Continue;
+        enum CXChildVisitResult next = is_function_decl(kind) ? CXChildVisit_Continue : CXChildVisit_Recurse;
+        CXString str = clang_getCursorUSR(cursor);
+        const char *usr = clang_getCString(str);
+        if (usr[0] != '\0') {
+                db->ingested++;
+                unsigned id = key_table_find(&db->usr_ids, usr, db_record_usr, db);
+                if (id == 0) {
+                        if (db_add(db, cursor, usr))
+                                state->added++;
+                        else
+                                state->failed = true;
+                } else if (!db->records[id - 1].is_definition && clang_isCursorDefinition(cursor)) {
+                        state->failed = !db_describe(db, &db->records[id - 1], cursor);
+                }
+        }
+        clang_disposeString(str);
+        return state->failed ? CXChildVisit_Break : next;
+}
+
+static void push_db_record(lua_State *L, const decl_db *db, unsigned id)
+{
+        const decl_record *record = &db->records[id - 1];
+        lua_createtable(L, 0, 8);
+        lua_pushstring(L, cursor_kind_str(record->kind));
+        lua_setfield(L, -2, "kind");
+        lua_pushstring(L, db_string(db, record->name));
+        lua_setfield(L, -2, "name");
+        lua_pushstring(L, db_string(db, record->usr));
+        lua_setfield(L, -2, "usr");
+        lua_pushstring(L, db_string(db, record->type));
+        lua_setfield(L, -2, "type");
+        if (db_string(db, record->file)[0] != '\0') {
+                lua_pushstring(L, db_string(db, record->file));
+                lua_setfield(L, -2, "file");
         }
+        lua_pushinteger(L, record->line);
+        lua_setfield(L, -2, "line");
+        lua_pushinteger(L, record->column);
+        lua_setfield(L, -2, "column");
+        lua_pushboolean(L, record->is_definition);
+        lua_setfield(L, -2, "isDefinition");
 }
 
 /*
-        Format - cur:getStorageClass()
-        Parameter - cur -Cursor whose storage class specifier is to be obtained
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga230c7904f3878469d772f3e464b9c83d
-        Returns the storage class specifier string
+        Format - luaclang.newDeclDB()
+        The database merges the declarations of any number of translation units by USR, keeping
+        one record per distinct declaration (its definition if one was seen). Records don't
+        refer to the translation units, which can be disposed once ingested, and their strings
+        are interned, so the memory used is bounded by the distinct declarations.
+        Returns a declaration database object
 */
-static int cursor_getstorageclass(lua_State *L)
+static int clang_newdecldb(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        enum CX_StorageClass sc_specifier = clang_Cursor_getStorageClass(*cur);
-        const char *sc_specifier_str = storage_class_str(sc_specifier);
-        if(sc_specifier_str == NULL)
-                luaL_error(L, "lua-clang: %s: unknown case %d", __func__, sc_specifier);
-        else
-                lua_pushstring(L, storage_class_str(sc_specifier));
+        decl_db *db;
+        new_object(L, db, DECL_DB_METATABLE);
+        memset(db, 0, sizeof(*db));
         return 1;
 }
 
+static decl_db *check_decl_db(lua_State *L)
+{
+        decl_db *db;
+        to_object(L, db, DECL_DB_METATABLE, 1);
+        luaL_argcheck(L, !db->disposed, 1, "database object was disposed");
+        return db;
+}
+
 /*
-        Format - cur:isBitField()
-        Parameter - cur -Cursor to be checked
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga750705f6b418b25ca00495b7392c740d
-        Returns 'true if the cursor represents a bitfield; 'false' otherwise
+        Format - db:ingest(parser)
+        Parameters - db - Declaration database
+                   - parser - Clang object whose top-level and nested declarations (function bodies
+                              excepted) are merged into the database
+        Returns the number of records added
 */
-static int cursor_isbitfield(lua_State *L)
+static int db_ingest(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_FieldDecl, 1, "expect cursor with struct/union field kind");
-        bool is_bitfield = clang_Cursor_isBitField(*cur);
-        lua_pushboolean(L, is_bitfield);
+        decl_db *db = check_decl_db(L);
+        clang_parser *parser;
+        to_object(L, parser, PARSER_METATABLE, 2);
+        luaL_argcheck(L, parser->tu != NULL, 2, "parser object was disposed");
+        ingest_state state = {db, 0, 0, false};
+        clang_visitChildren(clang_getTranslationUnitCursor(parser->tu), ingest_visitor, &state);
+        parser->stats.cursors_visited += state.visited;
+        if (state.failed)
+                return luaL_error(L, "not enough memory");
+        lua_pushinteger(L, state.added);
         return 1;
 }
 
 /*
-        Format - cur:getBitFieldWidth()
-        Parameter - cur - Cursor which represents the bitfield
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga80bbb872dde5b2f26964081338108f91
-        Returns the bit width of a bit field declaration as an integer
+        Format - db:count()
+        Parameter - db - Declaration database
+        Returns - 1. Number of records
+                  2. Number of declarations ingested, duplicates included
+*/
+static int db_count(lua_State *L)
+{
+        decl_db *db = check_decl_db(L);
+        lua_pushinteger(L, db->count);
+        lua_pushinteger(L, (lua_Integer) db->ingested);
+        return 2;
+}
+
+/*
+        Format - db:findByUSR(usr)
+        Parameters - db - Declaration database
+                   - usr - Unified Symbol Resolution of the declaration, as returned by cur:getUSR()
+        Returns the record of the declaration, a table with the fields kind, name, usr, type, file,
+        line, column and isDefinition, or nil
 */
-static int cursor_getbitfield_width(lua_State *L)
+static int db_findbyusr(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_Cursor_isBitField(*cur), 1, "expect cursor with struct/union field kind that is a bit field");
-        int bitfield_width = clang_getFieldDeclBitWidth(*cur);
-        lua_pushinteger(L, bitfield_width);
+        decl_db *db = check_decl_db(L);
+        unsigned id = key_table_find(&db->usr_ids, luaL_checkstring(L, 2), db_record_usr, db);
+        if (id == 0)
+                lua_pushnil(L);
+        else
+                push_db_record(L, db, id);
         return 1;
 }
 
 /*
-        Format - cur:getTypedefUnderlyingType()
-        Parameter - cur - Cursor which represents the TypedefDecl
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#ga8de899fc18dc859b6fe3b97309f4fd52
-        Returns the Underlying type of a TypedefDecl
+        Format - db:findDecl(name [, kind])
+        Parameters - db - Declaration database
+                   - name - Spelling of the declaration
+                   - kind - Optional cursor kind name or id (see cur:getKind(), cur:getKindId()) the declaration must have
+        Returns the record of the first declaration ingested with the given name and kind, or nil
 */
-static int cursor_gettypdef_underlying(lua_State *L)
+static int db_finddecl(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_argcheck(L, clang_getCursorKind(*cur) == CXCursor_TypedefDecl, 1, "expect cursor with typedef kind");
-        CXType *underlying_type;
-        new_object(L, underlying_type, TYPE_METATABLE);
-        *underlying_type = clang_getTypedefDeclUnderlyingType(*cur);
+        decl_db *db = check_decl_db(L);
+        const char *name = luaL_checkstring(L, 2);
+        int kind = opt_cursor_kind(L, 3);
+        unsigned id = key_table_find(&db->name_ids, name, db_record_name, db);
+        for (; id != 0; id = db->records[id - 1].next_name) {
+                if (kind == -1 || (int) db->records[id - 1].kind == kind) {
+                        push_db_record(L, db, id);
+                        return 1;
+                }
+        }
+        lua_pushnil(L);
+        return 1;
+}
+
+static int db_records_step(lua_State *L)
+{
+        decl_db *db = (decl_db *) lua_touserdata(L, lua_upvalueindex(1));
+        lua_Integer id = lua_tointeger(L, lua_upvalueindex(2)) + 1;
+        if (db->disposed || id > db->count)
+                return 0;
+        lua_pushinteger(L, id);
+        lua_replace(L, lua_upvalueindex(2));
+        push_db_record(L, db, id);
         return 1;
 }
 
 /*
-        Format - cur1:equals(cur2)
-        Parameters - cur1 - First cursor
-                   - cur2 - Second cursor
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__MANIP.html#ga98df58f09878710b983b6f3f60f0cba3
-        Returns a boolean value after comparing the two cursors for equality
+        Format - db:records()
+        Parameter - db - Declaration database
+        Returns an iterator over the records, in the order they were added
 */
-static int cursor_equals(lua_State *L)
+static int db_records(lua_State *L)
 {
-       CXCursor *cur1;
-       to_object(L, cur1, CURSOR_METATABLE, 1); 
-       CXCursor *cur2;
-       to_object(L, cur2, CURSOR_METATABLE, 2);
-       bool is_equal = clang_equalCursors(*cur1, *cur2);
-       lua_pushboolean(L, is_equal);
-       return 1;
+        check_decl_db(L);
+        lua_settop(L, 1);
+        lua_pushinteger(L, 0);
+        lua_pushcclosure(L, db_records_step, 2);
+        return 1;
 }
 
 /*
-        Format - cur:getCursorDefinition()
-        Parameter - cur - Cursor
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__XREF.html#gafcfbec461e561bf13f1e8540bbbd655b
-        Returns the cursor that describes the definition of cur
+        Format - db:dispose()
+        Parameter - db - Declaration database to be disposed
+        Returns nothing
 */
-static int cursor_getcursor_definition(lua_State *L)
+static int db_dispose(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        CXCursor *def_cur;
-        new_object(L, def_cur, CURSOR_METATABLE);
-        *def_cur = clang_getCursorDefinition(*cur);
-        return 1;
+        decl_db *db;
+        to_object(L, db, DECL_DB_METATABLE, 1);
+        if (db->disposed)
+                return 0;
+        free(db->records);
+        free(db->strings.data);
+        free(db->offsets);
+        free(db->string_ids.slots);
+        free(db->usr_ids.slots);
+        free(db->name_ids.slots);
+        memset(db, 0, sizeof(*db));
+        db->disposed = true;
+        return 0;
 }
 
-enum CXChildVisitResult visitor_function(CXCursor cursor, CXCursor parent, CXClientData client_data)
+/* --Indexing-- */
+
+/* State of index:indexFiles(), the callbacks run on the calling thread */
+typedef struct indexing_state {
+        lua_State *L;
+        kind_set kinds;
+        int batch_size;
+        int callback;           /* stack position of the batch function, 0 if the records are returned */
+        int batch;              /* stack position of the array of pending records */
+        int count;              /* records in the batch */
+        int file_names;         /* stack position of the table caching the names of the files */
+        int error;              /* stack position of the error raised by the batch function */
+        lua_Integer total;
+        bool failed;            /* the batch function raised an error */
+} indexing_state;
+
+static int indexing_abort(CXClientData client_data, void *reserved)
 {
-        lua_State *L = (lua_State*) client_data;
-        int nargs = lua_gettop(L);
-        lua_pushvalue(L, 1);    
-        CXCursor *cur;
-        new_object(L, cur, CURSOR_METATABLE);           
-        *cur = cursor;
-        CXCursor *par;
-        new_object(L, par, CURSOR_METATABLE);
-        *par = parent;
-        for (int i = 2; i <= nargs; i++) {
-                lua_pushvalue(L, i);
-        }
-        if (lua_pcall(L, nargs+1, 1, 0) != 0) {
-                return CXChildVisit_Break;
+        return ((indexing_state *) client_data)->failed;
+}
+
+/* Pass the pending records to the batch function and start a new batch */
+static void flush_batch(indexing_state *state)
+{
+        lua_State *L = state->L;
+        lua_pushvalue(L, state->callback);
+        lua_pushvalue(L, state->batch);
+        if (lua_pcall(L, 1, 0, 0) != 0) {
+                lua_replace(L, state->error);
+                state->failed = true;
+                return;
         }
-        const char *result = lua_tostring(L, -1);
-        if (strcmp(result, "continue") == 0) {
-                lua_pop(L, 1);
-                return CXChildVisit_Continue;
+        lua_createtable(L, state->batch_size, 0);
+        lua_replace(L, state->batch);
+        state->count = 0;
+}
+
+static void indexing_declaration(CXClientData client_data, const CXIdxDeclInfo *info)
+{
+        indexing_state *state = (indexing_state *) client_data;
+        lua_State *L = state->L;
+        enum CXCursorKind kind = clang_getCursorKind(info->cursor);
+        if (state->failed || info->entityInfo == NULL || !kind_set_has(&state->kinds, kind))
+                return;
+        if (!lua_checkstack(L, 8)) {
+                lua_pushliteral(L, "stack overflow while indexing");
+                lua_replace(L, state->error);
+                state->failed = true;
+                return;
         }
-        else if (strcmp(result, "recurse") == 0) {
-                lua_pop(L, 1);
-                return CXChildVisit_Recurse;
+        CXFile file;
+        unsigned line, column;
+        clang_indexLoc_getFileLocation(info->loc, NULL, &file, &line, &column, NULL);
+        lua_createtable(L, 0, 8);
+        lua_pushstring(L, cursor_kind_str(kind));
+        lua_setfield(L, -2, "kind");
+        if (info->entityInfo->name != NULL) {
+                lua_pushstring(L, info->entityInfo->name);
+                lua_setfield(L, -2, "name");
         }
-        else if (strcmp(result, "break") == 0) {
-                lua_pop(L, 1);
-                return CXChildVisit_Break;
+        if (info->entityInfo->USR != NULL) {
+                lua_pushstring(L, info->entityInfo->USR);
+                lua_setfield(L, -2, "usr");
         }
-        else {
-                lua_pushstring(L, "undefined return to visitor");
-                return CXChildVisit_Break;
+        if (file != NULL) {
+                if (lua_rawgetp(L, state->file_names, file) == LUA_TNIL) {
+                        lua_pop(L, 1);
+                        push_cxstring(L, clang_getFileName(file));
+                        lua_pushvalue(L, -1);
+                        lua_rawsetp(L, state->file_names, file);
+                }
+                lua_setfield(L, -2, "file");
         }
+        lua_pushinteger(L, line);
+        lua_setfield(L, -2, "line");
+        lua_pushinteger(L, column);
+        lua_setfield(L, -2, "column");
+        lua_pushboolean(L, info->isDefinition);
+        lua_setfield(L, -2, "isDefinition");
+        lua_pushboolean(L, info->isRedeclaration);
+        lua_setfield(L, -2, "isRedeclaration");
+        lua_rawseti(L, state->batch, ++state->count);
+        state->total++;
+        if (state->callback != 0 && state->count == state->batch_size)
+                flush_batch(state);
 }
 
-/*      
-        Format - cur:visitChildren(visitor_function)
-        Parameter - cur - Cursor whose children are to be visited  
-        A string should be returned by the visitor_function to indicate how visit_children should proceed : 
-                1. "break" - Terminates the cursor traversal 
-                2. "continue" - Continues the cursor traversal with the next sibling of the cursor just visited, without visiting its children
-                3. "recurse" - Recursively traverse the children of this cursor, using the same visitor and client data
-        More info - https://clang.llvm.org/doxygen/group__CINDEX__CURSOR__TRAVERSAL.html#ga5d0a813d937e1a7dcc35f206ad1f7a91
-        Returns nothing
+/*
+        Format - index:indexFiles(files [, options] [, batch_function])
+        Parameters - index - Index object the files are indexed in
+                   - files - Array of the names of the source files to index
+                   - options - Optional table, as accepted by luaclang.newParser() except for source, and :
+                        1. kinds - Array of cursor kinds (as returned by cur:getKind()) to report, all by default
+                        2. skipParsedBodies - Skip the function bodies already indexed for a previous file
+                        3. batchSize - Number of records passed per call of batch_function (default 256)
+                   - batch_function - Optional function called with arrays of records as they are indexed
+        The files are indexed with one CXIndexAction, the translation units aren't kept. Each
+        declaration is described by a record with the fields kind, name, usr, file, line, column,
+        isDefinition and isRedeclaration.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__HIGH.html
+        Returns - 1. The array of records if there is no batch_function, else the number of records
+                  2. A table mapping the position of each file which couldn't be indexed to the error message
 */
-static int cursor_visitchildren(lua_State *L)                               
+static int index_indexfiles(lua_State *L)
 {
-        CXCursor *cur;
-        to_object(L, cur, CURSOR_METATABLE, 1);
-        luaL_checktype(L, 2, LUA_TFUNCTION);
-        lua_remove(L, 1);
-        if (!lua_checkstack(L, lua_gettop(L)+2))
-                luaL_error(L, "excessive number of params");       
-        clang_visitChildren(*cur, visitor_function, L);
-        if (lua_isstring(L, lua_gettop(L))) {
-                luaL_error(L, lua_tostring(L, lua_gettop(L)));
-                return 1;
+        clang_index *index;
+        to_object(L, index, INDEX_METATABLE, 1);
+        luaL_argcheck(L, index->idx != NULL && !index->dispose_pending, 1, "index object was disposed");
+        luaL_checktype(L, 2, LUA_TTABLE);
+        if (lua_isfunction(L, 3)) {
+                lua_pushnil(L);
+                lua_insert(L, 3);
         }
-        return 0;
+        lua_settop(L, 4);
+        indexing_state state;
+        state.L = L;
+        state.batch_size = 256;
+        state.callback = lua_isnil(L, 4) ? 0 : 4;
+        state.count = 0;
+        state.total = 0;
+        state.failed = false;
+        unsigned index_options = CXIndexOpt_SuppressWarnings;
+        luaL_argcheck(L, state.callback == 0 || lua_isfunction(L, 4), 4, "expect a batch function");
+        if (!lua_isnil(L, 3)) {
+                luaL_checktype(L, 3, LUA_TTABLE);
+                lua_getfield(L, 3, "source");
+                luaL_argcheck(L, lua_isnil(L, -1), 3, "source isn't supported by indexFiles");
+                lua_getfield(L, 3, "batchSize");
+                if (!lua_isnil(L, -1)) {
+                        luaL_argcheck(L, lua_isinteger(L, -1) && lua_tointeger(L, -1) > 0, 3,
+                                      "expect a positive batchSize");
+                        state.batch_size = lua_tointeger(L, -1);
+                }
+                lua_pop(L, 2);
+                if (opt_boolean(L, 3, "skipParsedBodies", false))
+                        index_options |= CXIndexOpt_SkipParsedBodiesInSession;
+                lua_getfield(L, 3, "kinds");
+        } else {
+                lua_pushnil(L);
+        }
+        check_kind_set(L, 3, lua_gettop(L), &state.kinds);
+        lua_pop(L, 1);
+        parse_options opts;
+        check_parse_options(L, 3, NULL, &opts);
+        if (index->exclude_pch)
+                opts.pch = NULL;        /* the index would hide its declarations */
+        int num_files = luaL_len(L, 2);
+        for (int i = 1; i <= num_files; i++) {
+                lua_rawgeti(L, 2, i);
+                luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 2, "expect an array of file names");
+                lua_pop(L, 1);
+        }
+        lua_newtable(L);
+        state.file_names = lua_gettop(L);
+        lua_pushnil(L);
+        state.error = lua_gettop(L);
+        lua_newtable(L);
+        int errors = lua_gettop(L);
+        lua_newtable(L);
+        state.batch = lua_gettop(L);
+        IndexerCallbacks callbacks;
+        memset(&callbacks, 0, sizeof(callbacks));
+        callbacks.abortQuery = indexing_abort;
+        callbacks.indexDeclaration = indexing_declaration;
+        CXIndexAction action = clang_IndexAction_create(index->idx);
+        for (int i = 1; i <= num_files && !state.failed; i++) {
+                lua_rawgeti(L, 2, i);
+                const char *file_name = lua_tostring(L, -1);
+                lua_pop(L, 1);  /* still referenced by 'files' */
+                if (!is_unsaved_file(&opts, file_name) && access(file_name, F_OK) == -1) {
+                        lua_pushliteral(L, "file doesn't exist");
+                        lua_rawseti(L, errors, i);
+                        continue;
+                }
+                int num_args;
+                const char **args = parse_args(&opts, file_name, &num_args);
+                int err = clang_indexSourceFile(action, &state, &callbacks, sizeof(callbacks), index_options,
+                                                file_name, args, num_args, opts.unsaved,
+                                                opts.num_unsaved, NULL, opts.flags);
+                if (err != 0 && !state.failed) {
+                        lua_pushstring(L, parse_error_str(err));
+                        lua_rawseti(L, errors, i);
+                }
+        }
+        clang_IndexAction_dispose(action);
+        if (state.callback != 0 && state.count > 0 && !state.failed)
+                flush_batch(&state);
+        if (state.failed) {
+                lua_pushvalue(L, state.error);
+                return lua_error(L);
+        }
+        if (state.callback != 0)
+                lua_pushinteger(L, state.total);
+        else
+                lua_pushvalue(L, state.batch);
+        lua_pushvalue(L, errors);
+        return 2;
 }
 
-
 /* -- Type functions -- */
 
 /*
@@ -515,9 +5978,7 @@ static int type_getresult(lua_State *L)
         CXType *type;
         to_object(L, type, TYPE_METATABLE, 1);
         luaL_argcheck(L, type->kind == CXType_FunctionProto, 1, "expect type object with function kind");
-        CXType *result_type;
-        new_object(L, result_type, TYPE_METATABLE);
-        *result_type = clang_getResultType(*type);
+        push_type(L, clang_getResultType(*type));
         return 1;
 }
 
@@ -534,9 +5995,7 @@ static int type_getarg(lua_State *L)
         to_object(L, type, TYPE_METATABLE, 1);
         luaL_argcheck(L, type->kind == CXType_FunctionProto, 1, "expect type object with function kind");
         unsigned int index = luaL_checkinteger(L, 2);
-        CXType *arg_type;
-        new_object(L, arg_type, TYPE_METATABLE);
-        *arg_type = clang_getArgType(*type, index-1);
+        push_type(L, clang_getArgType(*type, index-1));
         return 1;
 }
 
@@ -551,9 +6010,7 @@ static int type_getarrtype(lua_State *L)
         CXType *type;
         to_object(L, type, TYPE_METATABLE, 1);
         luaL_argcheck(L, type->kind == CXType_ConstantArray || type->kind == CXType_VariableArray || type->kind == CXType_IncompleteArray || type->kind == CXType_DependentSizedArray, 1, "expect type object with array kind");
-        CXType *arr_type;
-        new_object(L, arr_type, TYPE_METATABLE);
-        *arr_type = clang_getArrayElementType(*type);
+        push_type(L, clang_getArrayElementType(*type));
         return 1;
 }
 
@@ -584,9 +6041,7 @@ static int type_getpointee_type(lua_State *L)
         CXType *type;
         to_object(L, type, TYPE_METATABLE, 1);
         luaL_argcheck(L, type->kind == CXType_Pointer, 1, "expect type object with pointer kind");
-        CXType *pointee_type;
-        new_object(L, pointee_type, TYPE_METATABLE);
-        *pointee_type = clang_getPointeeType(*type);
+        push_type(L, clang_getPointeeType(*type));
         return 1;
 }
 
@@ -601,9 +6056,21 @@ static int type_gettypekind(lua_State *L)
 {
         CXType *type;
         to_object(L, type, TYPE_METATABLE, 1);
-        CXString kind_str = clang_getTypeKindSpelling(type->kind);
-        lua_pushstring(L, clang_getCString(kind_str));
-        clang_disposeString(kind_str);
+        push_type_kind(L, type->kind);
+        return 1;
+}
+
+/*
+        Format - cur_type:getKindId()
+        Parameter - cur_type - Cursor type whose type kind is to be found
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html#gaad39de597b13a18882c21860f92b095a
+        Returns the type kind as the integer value of the CXTypeKind, see luaclang.typeKinds
+*/
+static int type_getkindid(lua_State *L)
+{
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 1);
+        lua_pushinteger(L, type->kind);
         return 1;
 }
 
@@ -623,6 +6090,123 @@ static int type_getnumargtypes(lua_State *L)
         return 1;
 }
 
+/*
+        Format - cur_type:getSize()
+        Parameter - cur_type - Type whose size is to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+        Returns the size of the type in bytes, as sizeof()
+*/
+static int type_getsize(lua_State *L)
+{
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 1);
+        long long size = clang_Type_getSizeOf(*type);
+        luaL_argcheck(L, size >= 0, 1, layout_error_str(size));
+        lua_pushinteger(L, size);
+        return 1;
+}
+
+/*
+        Format - cur_type:getAlign()
+        Parameter - cur_type - Type whose alignment is to be obtained
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+        Returns the alignment of the type in bytes, as alignof()
+*/
+static int type_getalign(lua_State *L)
+{
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 1);
+        long long align = clang_Type_getAlignOf(*type);
+        luaL_argcheck(L, align >= 0, 1, layout_error_str(align));
+        lua_pushinteger(L, align);
+        return 1;
+}
+
+/*
+        Format - cur_type:getOffsetOf(field)
+        Parameters - cur_type - Record type containing the field
+                   - field - Name of the field, fields of anonymous members are found as well
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+        Returns the offset of the field in bits
+*/
+static int type_getoffsetof(lua_State *L)
+{
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 1);
+        const char *field = luaL_checkstring(L, 2);
+        long long offset = clang_Type_getOffsetOf(*type, field);
+        luaL_argcheck(L, offset >= 0, offset == CXTypeLayoutError_InvalidFieldName ? 2 : 1, layout_error_str(offset));
+        lua_pushinteger(L, offset);
+        return 1;
+}
+
+static enum CXVisitorResult field_visitor(CXCursor cursor, CXClientData client_data)
+{
+        lua_State *L = (lua_State *) client_data;
+        CXType type = clang_getCursorType(cursor);
+        lua_createtable(L, 0, 4);
+        if (clang_Cursor_isAnonymousRecordDecl(clang_getTypeDeclaration(type)))
+                lua_pushliteral(L, "");         /* implicit field of an anonymous struct/union member */
+        else
+                push_cxstring(L, clang_getCursorSpelling(cursor));
+        lua_setfield(L, -2, "name");
+        push_type(L, type);
+        lua_setfield(L, -2, "type");
+        long long offset = clang_Cursor_getOffsetOfField(cursor);
+        if (offset >= 0) {      /* else a CXTypeLayoutError, eg. for a field of incomplete type */
+                lua_pushinteger(L, offset);
+                lua_setfield(L, -2, "offset");
+        }
+        if (clang_Cursor_isBitField(cursor)) {
+                lua_pushinteger(L, clang_getFieldDeclBitWidth(cursor));
+                lua_setfield(L, -2, "bitWidth");
+        }
+        lua_rawseti(L, -2, luaL_len(L, -2) + 1);
+        return CXVisit_Continue;
+}
+
+/*
+        Format - cur_type:getFields()
+        Parameter - cur_type - Complete record type whose fields are to be listed
+        Each field is described by a table with the fields name, type, offset (in bits, absent if
+        libclang can't compute it) and bitWidth (bit fields only). Anonymous struct/union members are listed with an empty name.
+        More info - https://clang.llvm.org/doxygen/group__CINDEX__TYPES.html
+        Returns an array with the fields in declaration order
+*/
+static int type_getfields(lua_State *L)
+{
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 1);
+        luaL_argcheck(L, clang_getCanonicalType(*type).kind == CXType_Record, 1, "expect type object with record kind");
+        long long size = clang_Type_getSizeOf(*type);
+        luaL_argcheck(L, size >= 0, 1, layout_error_str(size));
+        lua_newtable(L);
+        clang_Type_visitFields(*type, field_visitor, L);
+        return 1;
+}
+
+/* __eq metamethod, comparing a type with any other object */
+static int type_eq(lua_State *L)
+{
+        CXType *type1 = (CXType *) luaL_testudata(L, 1, TYPE_METATABLE);
+        CXType *type2 = (CXType *) luaL_testudata(L, 2, TYPE_METATABLE);
+        lua_pushboolean(L, type1 != NULL && type2 != NULL && clang_equalTypes(*type1, *type2));
+        return 1;
+}
+
+/*
+        Format - cur_type:hash()
+        Parameter - cur_type - Type to be hashed
+        Returns an integer, equal for equal types
+*/
+static int type_hashvalue(lua_State *L)
+{
+        CXType *type;
+        to_object(L, type, TYPE_METATABLE, 1);
+        lua_pushinteger(L, type_hash(*type));
+        return 1;
+}
+
 /*
         Format - cur_type:getTypeDeclaration()
         Parameter - cur_type - Type object whose cursor is to be obtained
@@ -633,31 +6217,236 @@ static int type_gettypedecl(lua_State *L)
 {
         CXType *type;
         to_object(L, type, TYPE_METATABLE, 1);
-        CXCursor *cur;
-        new_object(L, cur, CURSOR_METATABLE);
-        *cur = clang_getTypeDeclaration(*type);
+        push_cursor(L, clang_getTypeDeclaration(*type));
+        return 1;
+}
+
+/* --Parse handle functions-- */
+
+/* Check the handle at 'arg' has neither been cancelled nor its parser been taken */
+static async_parse *check_parse_job(lua_State *L, int arg)
+{
+        parse_handle *handle;
+        to_object(L, handle, PARSE_HANDLE_METATABLE, arg);
+        luaL_argcheck(L, !handle->cancelled, arg, "parse was cancelled");
+        return handle->job;
+}
+
+/*
+        Format - handle:ready()
+        Parameter - handle - Handle returned by luaclang.parseAsync()
+        Returns true if the parse has finished
+*/
+static int handle_ready(lua_State *L)
+{
+        async_parse *job = check_parse_job(L, 1);
+        bool done = true;
+        if (job != NULL) {
+                pthread_mutex_lock(&job->lock);
+                done = job->done;
+                pthread_mutex_unlock(&job->lock);
+        }
+        lua_pushboolean(L, done);
+        return 1;
+}
+
+/* Wait until 'job' is done, at most 'seconds' if not negative, and return whether it is */
+static bool parse_job_wait(async_parse *job, double seconds)
+{
+        struct timespec deadline;
+        if (seconds >= 0) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                double nsec = deadline.tv_nsec + (seconds - (time_t) seconds) * 1e9;
+                deadline.tv_sec += (time_t) seconds + (time_t) (nsec / 1e9);
+                deadline.tv_nsec = (long) nsec % 1000000000L;
+        }
+        pthread_mutex_lock(&job->lock);
+        while (!job->done) {
+                if (seconds < 0)
+                        pthread_cond_wait(&job->finished, &job->lock);
+                else if (pthread_cond_timedwait(&job->finished, &job->lock, &deadline) != 0)
+                        break;
+        }
+        bool done = job->done;
+        pthread_mutex_unlock(&job->lock);
+        return done;
+}
+
+/*
+        Format - handle:wait([seconds])
+        Parameters - handle - Handle returned by luaclang.parseAsync()
+                   - seconds - Optional maximum time to wait
+        Returns true if the parse has finished
+*/
+static int handle_wait(lua_State *L)
+{
+        async_parse *job = check_parse_job(L, 1);
+        double seconds = luaL_optnumber(L, 2, -1);
+        luaL_argcheck(L, lua_isnoneornil(L, 2) || seconds >= 0, 2, "expect a non-negative number of seconds");
+        lua_pushboolean(L, job == NULL || parse_job_wait(job, seconds));
+        return 1;
+}
+
+/*
+        Format - handle:result()
+        Parameter - handle - Handle returned by luaclang.parseAsync()
+        Waits for the parse if it is still running.
+        Returns clang object whose translation unit cursor can be obtained, the same one on every call
+*/
+static int handle_result(lua_State *L)
+{
+        async_parse *job = check_parse_job(L, 1);
+        parse_handle *handle = (parse_handle *) lua_touserdata(L, 1);
+        lua_getuservalue(L, 1);
+        int uservalue = lua_gettop(L);
+        if (job == NULL) {
+                lua_getfield(L, uservalue, "parser");
+                luaL_argcheck(L, !lua_isnil(L, -1), 1, "translation unit wasn't created");
+                return 1;
+        }
+        parse_job_wait(job, -1);
+        if (job->err != CXError_Success) {
+                handle->job = NULL;
+                lua_pushstring(L, parse_error_str(job->err));
+                async_parse_release(job);
+                return luaL_argerror(L, 1, lua_tostring(L, -1));
+        }
+        clang_parser *parser = new_parser(L, job->idx, 0);
+        parser->tu = job->tu;
+        parser->stats.parse_time = job->parse_time;
+        parser->stats.used_pch = !job->exclude_pch;
+        register_parser(L, -1, parser->tu);
+        parser->unsaved = handle->unsaved;
+        parser->num_unsaved = handle->num_unsaved;
+        job->idx = NULL;
+        job->tu = NULL;
+        handle->job = NULL;
+        async_parse_release(job);
+        lua_getuservalue(L, -1);
+        lua_getfield(L, uservalue, "options");
+        lua_setfield(L, -2, "options");
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_setfield(L, uservalue, "parser");
         return 1;
 }
 
+/*
+        Format - handle:cancel()
+        Parameter - handle - Handle returned by luaclang.parseAsync()
+        Discards the result of the parse, the handle can't be used anymore
+        Returns nothing
+*/
+static int handle_cancel(lua_State *L)
+{
+        parse_handle *handle;
+        to_object(L, handle, PARSE_HANDLE_METATABLE, 1);
+        if (handle->job != NULL) {
+                async_parse_release(handle->job);
+                handle->job = NULL;
+        }
+        handle->cancelled = true;
+        return 0;
+}
+
+/*
+        Format - handle:fd()
+        Parameter - handle - Handle returned by luaclang.parseAsync()
+        The descriptor stays open until the handle is cancelled, its result taken, or it is collected.
+        Returns a file descriptor which becomes readable once the parse has finished
+*/
+static int handle_fd(lua_State *L)
+{
+        async_parse *job = check_parse_job(L, 1);
+        luaL_argcheck(L, job != NULL, 1, "result was already taken");
+        lua_pushinteger(L, job->fds[0]);
+        return 1;
+}
+
+static int handle_gc(lua_State *L)
+{
+        parse_handle *handle;
+        to_object(L, handle, PARSE_HANDLE_METATABLE, 1);
+        if (handle->job != NULL) {
+                async_parse_release(handle->job);
+                handle->job = NULL;
+        }
+        return 0;
+}
+
 static luaL_Reg clang_functions[] = {
         {"newParser", clang_newparser},
+        {"newIndex", clang_newindex},
+        {"loadParser", clang_loadparser},
+        {"parseAll", clang_parseall},
+        {"parseAsync", clang_parseasync},
+        {"extractCached", clang_extractcached},
+        {"newDeclDB", clang_newdecldb},
+        {"usePCH", clang_usepch},
         {"getNullCursor", clang_getnullcursor},
         {NULL, NULL}
 };
 
+static luaL_Reg decl_db_functions[] = {
+        {"ingest", db_ingest},
+        {"count", db_count},
+        {"findByUSR", db_findbyusr},
+        {"findDecl", db_finddecl},
+        {"records", db_records},
+        {"dispose", db_dispose},
+        {"__gc", db_dispose},
+        {NULL, NULL}
+};
+
+static luaL_Reg index_functions[] = {
+        {"newParser", index_newparser},
+        {"loadParser", index_loadparser},
+        {"indexFiles", index_indexfiles},
+        {"setGlobalOptions", index_setglobaloptions},
+        {"getGlobalOptions", index_getglobaloptions},
+        {"dispose", index_dispose},
+        {"__gc", index_dispose},
+        {NULL, NULL}
+};
+
 static luaL_Reg parser_functions[] = {
         {"dispose", parser_dispose},
         {"getCursor", parser_getcursor},
+        {"reparse", parser_reparse},
+        {"save", parser_save},
         {"__gc", parser_dispose},
         {"getNumDiagnostics", parser_getnumdiagnostics},
         {"getDiagnostic", parser_getdiagnostic},
+        {"getDiagnostics", parser_getdiagnostics},
+        {"getMacros", parser_getmacros},
+        {"buildIndex", parser_buildindex},
+        {"findDecl", parser_finddecl},
+        {"findByUSR", parser_findbyusr},
+        {"internType", parser_interntype},
+        {"getTypeInfo", parser_gettypeinfo},
+        {"getTypes", parser_gettypes},
+        {"stats", parser_stats},
+        {NULL, NULL}
+};
+
+static luaL_Reg parse_handle_functions[] = {
+        {"ready", handle_ready},
+        {"wait", handle_wait},
+        {"result", handle_result},
+        {"cancel", handle_cancel},
+        {"fd", handle_fd},
+        {"__gc", handle_gc},
         {NULL, NULL}
 };
 
 static luaL_Reg cursor_functions[] = {
         {"getSpelling", cursor_getspelling}, 
+        {"getUSR", cursor_getusr},
         {"getKind", cursor_getkind}, 
+        {"getKindId", cursor_getkindid},
         {"visitChildren", cursor_visitchildren}, 
+        {"children", cursor_children},
+        {"descendants", cursor_descendants},
         {"getType", cursor_gettype}, 
         {"getNumArgs", cursor_getnumargs}, 
         {"getArgCursor", cursor_getarg},
@@ -668,7 +6457,20 @@ static luaL_Reg cursor_functions[] = {
         {"getBitFieldWidth", cursor_getbitfield_width},
         {"getTypedefUnderlyingType", cursor_gettypdef_underlying},
         {"equals", cursor_equals},
+        {"hash", cursor_hash},
+        {"__eq", cursor_eq},
+        {"clone", cursor_clone},
+        {"getFieldOffset", cursor_getfieldoffset},
         {"getCursorDefinition", cursor_getcursor_definition},
+        {"extract", cursor_extract},
+        {"getCdef", cursor_getcdef},
+        {NULL, NULL}
+};
+
+static luaL_Reg cursor_iterator_functions[] = {
+        {"prune", iterator_prune},
+        {"__call", iterator_call},
+        {"__gc", iterator_gc},
         {NULL, NULL}
 };
 
@@ -680,11 +6482,32 @@ static luaL_Reg type_functions[] = {
         {"getArraySize", type_getarrsize},
         {"getPointeeType", type_getpointee_type},
         {"getTypeKind", type_gettypekind},
+        {"getKindId", type_getkindid},
         {"getNumArgTypes", type_getnumargtypes},   
         {"getTypeDeclaration", type_gettypedecl}, 
+        {"getSize", type_getsize},
+        {"getAlign", type_getalign},
+        {"getOffsetOf", type_getoffsetof},
+        {"getFields", type_getfields},
+        {"hash", type_hashvalue},
+        {"__eq", type_eq},
         {NULL, NULL}
 };
 
+/* Push a table mapping every name in 'names' to its kind, and every kind back to its name */
+static void push_kind_table(lua_State *L, const char *const *names, unsigned count)
+{
+        lua_createtable(L, 0, 2 * count);
+        for (unsigned kind = 0; kind < count; kind++) {
+                if (names[kind] == NULL)
+                        continue;
+                lua_pushinteger(L, kind);
+                lua_setfield(L, -2, names[kind]);
+                lua_pushstring(L, names[kind]);
+                lua_rawseti(L, -2, kind);
+        }
+}
+
 void new_metatable(lua_State *L, const char *name, luaL_Reg *reg)
 {
         luaL_newmetatable(L, name);
@@ -696,11 +6519,61 @@ void new_metatable(lua_State *L, const char *name, luaL_Reg *reg)
 
 int luaopen_luaclang(lua_State *L) 
 {
+        new_metatable(L, INDEX_METATABLE, index_functions);
         new_metatable(L, PARSER_METATABLE, parser_functions);
+        new_metatable(L, PARSE_HANDLE_METATABLE, parse_handle_functions);
         new_metatable(L, CURSOR_METATABLE, cursor_functions);
+        new_metatable(L, CURSOR_ITERATOR_METATABLE, cursor_iterator_functions);
         new_metatable(L, TYPE_METATABLE, type_functions);
+        new_metatable(L, DECL_DB_METATABLE, decl_db_functions);
+        lua_newtable(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, CURSOR_CACHE);
+        lua_newtable(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, TYPE_CACHE);
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushliteral(L, "v");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, PARSER_REGISTRY);
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, DIAGNOSTIC_PATHS);
+        luaL_newmetatable(L, PARSE_JOBS_METATABLE);
+        lua_pushcfunction(L, parse_jobs_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pop(L, 1);
+        luaL_newmetatable(L, EXTRACT_RESOURCES_METATABLE);
+        lua_pushcfunction(L, extract_resources_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pop(L, 1);
+        luaL_newmetatable(L, PCH_POOL_METATABLE);
+        lua_pushcfunction(L, pch_gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pop(L, 1);
+        luaL_newmetatable(L, DIAGNOSTIC_METATABLE);
+        lua_pushcfunction(L, diagnostic_index);
+        lua_setfield(L, -2, "__index");
+        lua_pop(L, 1);
+
+        lua_newuserdata(L, 0);
+        lua_newtable(L);
+        lua_pushcfunction(L, wait_running_parses);
+        lua_setfield(L, -2, "__gc");
+        lua_setmetatable(L, -2);
+        lua_setfield(L, LUA_REGISTRYINDEX, "Clang.RunningParses");
+        /* private copy of luaclang.cursorKinds, which scripts may modify */
+        push_kind_table(L, cursor_kind_names, NUM_CURSOR_KINDS);
+        lua_setfield(L, LUA_REGISTRYINDEX, CURSOR_KIND_IDS);
 
         lua_newtable(L);
         luaL_setfuncs(L, clang_functions, 0);
+        push_kind_table(L, cursor_kind_names, NUM_CURSOR_KINDS);
+        lua_setfield(L, -2, "cursorKinds");
+        push_kind_table(L, type_kind_names, NUM_TYPE_KINDS);
+        lua_setfield(L, -2, "typeKinds");
         return 1;
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+typedef struct { int a; } anon_t;
+enum { FLAG_A = 1, FLAG_B = 2 };
+struct outer {
+        int x;
+        struct inner { float f; } in;
+        union { int u1; float u2; };
+        unsigned flags : 3;
+        int arr[4][2];
+        void (*cb)(int, ...);
+};
+typedef int (*binop)(int, int);
+int (*get_op(char c))(int, int);
+void nothing(void);
+static int hidden(void);
+extern const char *names[];
@@ -728,4 +728,1400 @@ describe("cursor_type:getTypeDeclaration()", function()
                 local type_decl = cursor_type:getTypeDeclaration() 
                 assert.is_true(struct_decl:equals(type_decl))    
         end)       
-end)
\ No newline at end of file
+end)
+
+--Index functions
+
+describe("luaclang.newIndex()", function()
+        it("creates an index object", function()
+                local index = luaclang.newIndex()
+                assert.are.same('userdata', type(index))
+                index:dispose()
+        end)
+
+        it("applies the global options", function()
+                local index = luaclang.newIndex{threadBackgroundPriorityForIndexing = true}
+                local expected = {
+                        threadBackgroundPriorityForIndexing = true,
+                        threadBackgroundPriorityForEditing = false
+                }
+                assert.are.same(expected, index:getGlobalOptions())
+                index:setGlobalOptions{threadBackgroundPriorityForEditing = true}
+                assert.is_true(index:getGlobalOptions().threadBackgroundPriorityForEditing)
+                index:dispose()
+        end)
+end)
+
+describe("index:newParser()", function()
+        it("creates parser objects sharing the index", function()
+                local index = luaclang.newIndex()
+                local p1 = index:newParser("spec/visit.c")
+                local p2 = index:newParser("spec/struct.c")
+                assert.are.equals("spec/visit.c", p1:getCursor():getSpelling())
+                assert.are.equals("spec/struct.c", p2:getCursor():getSpelling())
+                p1:dispose()
+                p2:dispose()
+                index:dispose()
+        end)
+
+        it("keeps parsers usable after the index was disposed", function()
+                local index = luaclang.newIndex()
+                local parser = index:newParser("spec/visit.c")
+                index:dispose()
+                assert.are.equals("spec/visit.c", parser:getCursor():getSpelling())
+                assert.has.errors(function()
+                        index:newParser("spec/visit.c")
+                end, "calling 'newParser' on bad self (index object was disposed)")
+                parser:dispose()
+        end)
+
+        it("fails to create an object for an unavailable file", function()
+                local index = luaclang.newIndex()
+                assert.has.errors(function()
+                        index:newParser("non_existent.c")
+                end, "file doesn't exist")
+                index:dispose()
+        end)
+end)
+
+describe("luaclang.newParser(file_name, options)", function()
+        it("passes compiler arguments", function()
+                local parser = luaclang.newParser("spec/options.c", {args = {"-DWITH_EXTRA"}})
+                local cursor = parser:getCursor()
+                local expected = {"extra", "add"}
+                local children = {}
+                cursor:visitChildren(function(cursor, parent)
+                        table.insert(children, cursor:getSpelling())
+                        return "continue"
+                end)
+                assert.are.same(expected, children)
+                parser:dispose()
+        end)
+
+        it("skips function bodies", function()
+                local function count_children(parser)
+                        local func = get_last_child(parser:getCursor())
+                        local count = 0
+                        func:visitChildren(function(cursor, parent)
+                                count = count + 1
+                                return "continue"
+                        end)
+                        return count
+                end
+                local parser = luaclang.newParser("spec/options.c")
+                assert.are.equal(3, count_children(parser))
+                parser:dispose()
+                parser = luaclang.newParser("spec/options.c", {skipFunctionBodies = true})
+                assert.are.equal(2, count_children(parser))
+                parser:dispose()
+        end)
+
+        it("uses non-string compiler arguments", function()
+                assert.has.errors(function()
+                        luaclang.newParser("spec/options.c", {args = {42, {}}})
+                end, "bad argument #2 to 'newParser' (expect string compiler arguments)")
+        end)
+end)
+
+describe("luaclang.newParser(file_name, {source = ..., unsaved = ...})", function()
+        it("parses a source string", function()
+                local parser = luaclang.newParser("virtual.c", {source = "struct point { int x, y; };"})
+                local cursor = parser:getCursor()
+                assert.are.equals("virtual.c", cursor:getSpelling())
+                assert.are.equals("point", get_last_child(cursor):getSpelling())
+                parser:dispose()
+        end)
+
+        it("overlays virtual files", function()
+                local parser = luaclang.newParser("spec/virtual.c", {
+                        source = '#include "config.h"\nint value = VALUE;',
+                        unsaved = {["spec/config.h"] = "#define VALUE 42\nstruct config { int x; };"}
+                })
+                local expected = {"config", "value"}
+                local children = {}
+                parser:getCursor():visitChildren(function(cursor, parent)
+                        table.insert(children, cursor:getSpelling())
+                        return "continue"
+                end)
+                assert.are.same(expected, children)
+                assert.are.equal(0, parser:getNumDiagnostics())
+                parser:dispose()
+        end)
+
+        it("overrides the contents of a file on disk", function()
+                local parser = luaclang.newParser("spec/struct.c", {unsaved = {["spec/struct.c"] = "enum flags { A };"}})
+                assert.are.equals("EnumDecl", get_last_child(parser:getCursor()):getKind())
+                parser:dispose()
+        end)
+
+        it("uses a non-string source", function()
+                assert.has.errors(function()
+                        luaclang.newParser("virtual.c", {source = {}})
+                end, "bad argument #2 to 'newParser' (expect source string)")
+        end)
+end)
+
+describe("parser:reparse()", function()
+        it("picks up the new contents of unsaved files", function()
+                local parser = luaclang.newParser("spec/virtual.c", {
+                        source = "struct before { int x; };",
+                        precompiledPreamble = true
+                })
+                assert.are.equals("before", get_last_child(parser:getCursor()):getSpelling())
+                parser:reparse({["spec/virtual.c"] = "struct after { int y; };"})
+                assert.are.equals("after", get_last_child(parser:getCursor()):getSpelling())
+                parser:reparse()
+                assert.are.equals("after", get_last_child(parser:getCursor()):getSpelling())
+                parser:dispose()
+        end)
+
+        it("keeps the source when other unsaved files are given", function()
+                local parser = luaclang.newParser("spec/virtual.c", {
+                        source = "#include \"virtual.h\"\nstruct uses { VALUE_TYPE v; };",
+                        unsaved = {["spec/virtual.h"] = "#define VALUE_TYPE int"}
+                })
+                parser:reparse({["spec/virtual.h"] = "#define VALUE_TYPE long"})
+                local field = parser:getCursor():extract()[1].fields[1]
+                assert.are.equals("long", field.type)
+                parser:dispose()
+        end)
+
+        it("fails to reparse a disposed parser object", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                parser:dispose()
+                assert.has.errors(function()
+                        parser:reparse()
+                end, "calling 'reparse' on bad self (parser object was disposed)")
+        end)
+end)
+
+describe("parser:save() and luaclang.loadParser()", function()
+        it("reloads a saved translation unit", function()
+                local ast_file = os.tmpname()
+                local parser = luaclang.newParser("spec/visit.c")
+                parser:save(ast_file)
+                parser:dispose()
+                local loaded = luaclang.loadParser(ast_file)
+                local expected = {"outer", "type"}
+                local children = {}
+                loaded:getCursor():visitChildren(function(cursor, parent)
+                        table.insert(children, cursor:getSpelling())
+                        return "continue"
+                end)
+                assert.are.same(expected, children)
+                loaded:dispose()
+                os.remove(ast_file)
+        end)
+
+        it("reloads a saved translation unit into a shared index", function()
+                local ast_file = os.tmpname()
+                local index = luaclang.newIndex()
+                local parser = index:newParser("spec/struct.c")
+                parser:save(ast_file)
+                local loaded = index:loadParser(ast_file)
+                assert.are.equals("bits", get_last_child(loaded:getCursor()):getSpelling())
+                parser:dispose()
+                loaded:dispose()
+                index:dispose()
+                os.remove(ast_file)
+        end)
+
+        it("fails to load an unavailable file", function()
+                assert.has.errors(function()
+                        luaclang.loadParser("non_existent.ast")
+                end, "file doesn't exist")
+        end)
+
+        it("fails to load a file which isn't an AST file", function()
+                assert.has.errors(function()
+                        luaclang.loadParser("spec/visit.c")
+                end, "bad argument #1 to 'loadParser' (translation unit wasn't created)")
+        end)
+end)
+
+describe("cursor:extract()", function()
+        it("extracts the declaration tree", function()
+                local parser = luaclang.newParser("spec/extract.c")
+                local decls = parser:getCursor():extract()
+                local kinds = {}
+                for _, decl in ipairs(decls) do
+                        table.insert(kinds, decl.kind)
+                end
+                assert.are.same({"StructDecl", "EnumDecl", "TypedefDecl", "FunctionDecl", "VarDecl"}, kinds)
+                local point, color, typedef, func, var = table.unpack(decls)
+                assert.are.same({kind = "FieldDecl", spelling = "y", type = "int", bitWidth = 4,
+                                 file = "spec/extract.c", line = 3, column = 13}, point.fields[2])
+                assert.is_true(point.isDefinition)
+                assert.are.same({"red", 0, "green", 5}, {color.values[1].spelling, color.values[1].value,
+                                                         color.values[2].spelling, color.values[2].value})
+                assert.are.equals("struct point", typedef.underlying)
+                assert.are.equals("extern", func.storage)
+                assert.are.equals("int", func.result)
+                assert.are.same({"a", "b"}, {func.args[1].spelling, func.args[2].spelling})
+                assert.are.equals("static", var.storage)
+                parser:dispose()
+        end)
+
+        it("filters by kinds", function()
+                local parser = luaclang.newParser("spec/extract.c")
+                local decls = parser:getCursor():extract{kinds = {"FunctionDecl", "VarDecl"}}
+                assert.are.same({"distance", "counter"}, {decls[1].spelling, decls[2].spelling})
+                assert.are.equal(2, #decls)
+                parser:dispose()
+        end)
+
+        it("limits the depth", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local cursor = parser:getCursor()
+                local outer = cursor:extract()[1]
+                assert.are.same({"first", "inner_var"}, {outer.fields[1].spelling, outer.fields[2].spelling})
+                assert.are.equals("inner", outer.children[1].spelling)
+                assert.are.equals("second", outer.children[1].fields[1].spelling)
+                outer = cursor:extract{maxDepth = 1}[1]
+                assert.is_nil(outer.children)
+                parser:dispose()
+        end)
+
+        it("uses an unknown cursor kind", function()
+                local parser = luaclang.newParser("spec/extract.c")
+                assert.has.errors(function()
+                        parser:getCursor():extract{kinds = {"NoSuchDecl"}}
+                end, "bad argument #1 to 'extract' (unknown cursor kind)")
+                parser:dispose()
+        end)
+end)
+
+describe("cursor:visitChildren(options, visitor_function)", function()
+        local function visit_spellings(parser, options)
+                local children = {}
+                parser:getCursor():visitChildren(options, function(cursor, parent, children)
+                        table.insert(children, cursor:getSpelling())
+                        return "recurse"
+                end, children)
+                return children
+        end
+
+        local function new_parser()
+                return luaclang.newParser("spec/virtual.c", {
+                        source = '#include "config.h"\n#include <sys.h>\nstruct main { int m; };',
+                        args = {"-isystem", "spec/sys"},
+                        unsaved = {
+                                ["spec/config.h"] = "struct config { int c; };",
+                                ["spec/sys/sys.h"] = "struct sys { int s; };"
+                        }
+                })
+        end
+
+        it("filters by kinds", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                assert.are.same({"type"}, visit_spellings(parser, {kinds = {"EnumDecl"}}))
+                parser:dispose()
+        end)
+
+        it("visits the nested cursors of the selected kinds", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                -- libclang visits struct inner again as a child of inner_var
+                assert.are.same({"first", "second", "inner_var", "second"},
+                                visit_spellings(parser, {kinds = {"FieldDecl"}}))
+                assert.are.same({"outer", "inner", "inner"}, visit_spellings(parser, {kinds = {"StructDecl"}}))
+                parser:dispose()
+                parser = new_parser()
+                assert.are.same({"c"}, visit_spellings(parser, {kinds = {"FieldDecl"}, files = {"spec/config.h"}}))
+                parser:dispose()
+        end)
+
+        it("only visits the main file", function()
+                local parser = new_parser()
+                assert.are.same({"main", "m"}, visit_spellings(parser, {mainFileOnly = true}))
+                parser:dispose()
+        end)
+
+        it("skips system headers", function()
+                local parser = new_parser()
+                assert.are.same({"config", "c", "main", "m"}, visit_spellings(parser, {skipSystemHeaders = true}))
+                parser:dispose()
+        end)
+
+        it("only visits the allowed files", function()
+                local parser = new_parser()
+                assert.are.same({"config", "c"}, visit_spellings(parser, {files = {"spec/config.h"}}))
+                parser:dispose()
+        end)
+
+        it("visits every cursor with empty options", function()
+                local parser = new_parser()
+                assert.are.same({"config", "c", "sys", "s", "main", "m"}, visit_spellings(parser, {}))
+                parser:dispose()
+        end)
+end)
+
+describe("cursor:visitChildren{reuseCursors = true}", function()
+        it("passes the same cursor objects for every node", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local expected = {
+                                        {"outer", "spec/visit.c"},
+                                        {"first", "outer"},
+                                        {"inner", "outer"},
+                                        {"second", "inner"},
+                                        {"inner_var", "outer"},
+                                        {"inner", "inner_var"},
+                                        {"second", "inner"},
+                                        {"type", "spec/visit.c"},
+                                        {"Integer", "type"},
+                                        {"Float", "type"},
+                                        {"String", "type"}
+                                 }
+                local children, objects, kept = {}, {}, {}
+                parser:getCursor():visitChildren({reuseCursors = true}, function(cursor, parent)
+                        table.insert(children, {cursor:getSpelling(), parent:getSpelling()})
+                        objects[cursor] = true
+                        table.insert(kept, cursor:clone())
+                        return "recurse"
+                end)
+                assert.are.same(expected, children)
+                local count = 0
+                for _ in pairs(objects) do
+                        count = count + 1
+                end
+                assert.are.equal(1, count)
+                assert.are.equals("outer", kept[1]:getSpelling())
+                assert.are.equals("String", kept[#kept]:getSpelling())
+                parser:dispose()
+        end)
+end)
+
+describe("cursor:clone()", function()
+        it("returns an equal cursor object", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local cursor = parser:getCursor()
+                local copy = cursor:clone()
+                assert.is_true(rawequal(cursor, copy))
+                assert.is_true(cursor:equals(copy))
+                parser:dispose()
+        end)
+end)
+
+describe("cursor:children()", function()
+        it("iterates over the direct children", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local names = {}
+                for cursor in parser:getCursor():children() do
+                        table.insert(names, cursor:getSpelling())
+                end
+                assert.are.same({"outer", "type"}, names)
+                parser:dispose()
+        end)
+
+        it("ends immediately for a cursor without children", function()
+                local count = 0
+                for _ in luaclang.getNullCursor():children() do
+                        count = count + 1
+                end
+                assert.are.equal(0, count)
+        end)
+end)
+
+describe("cursor:descendants()", function()
+        it("iterates depth first with the depth of each cursor", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local expected = {
+                                        {"outer", 1}, {"first", 2}, {"inner", 2}, {"second", 3},
+                                        {"inner_var", 2}, {"inner", 3}, {"second", 4},
+                                        {"type", 1}, {"Integer", 2}, {"Float", 2}, {"String", 2}
+                                 }
+                local visited = {}
+                for cursor, depth in parser:getCursor():descendants() do
+                        table.insert(visited, {cursor:getSpelling(), depth})
+                end
+                assert.are.same(expected, visited)
+                parser:dispose()
+        end)
+
+        it("skips the children of a pruned cursor", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local names = {}
+                local iterator = parser:getCursor():descendants()
+                for cursor in iterator do
+                        table.insert(names, cursor:getSpelling())
+                        if cursor:getKind() == "StructDecl" then
+                                iterator:prune()
+                        end
+                end
+                assert.are.same({"outer", "type", "Integer", "Float", "String"}, names)
+                parser:dispose()
+        end)
+
+        it("can yield from the loop body", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local walk = coroutine.wrap(function()
+                        for cursor in parser:getCursor():descendants() do
+                                coroutine.yield(cursor:getSpelling())
+                        end
+                end)
+                assert.are.equal("outer", walk())
+                assert.are.equal("first", walk())
+                assert.are.equal("inner", walk())
+                parser:dispose()
+        end)
+end)
+
+describe("cursor and type identity", function()
+        it("returns the same object for equal cursors", function()
+                local parser = luaclang.newParser("spec/function.c")
+                local cur = get_last_child(parser:getCursor())
+                assert.is_true(rawequal(cur:getArgCursor(1), cur:getArgCursor(1)))
+                assert.is_true(rawequal(parser:getCursor(), parser:getCursor()))
+                local seen = {}
+                seen[cur:getArgCursor(1)] = true
+                assert.is_true(seen[cur:getArgCursor(1)])
+                parser:dispose()
+        end)
+
+        it("returns the same object for equal types", function()
+                local parser = luaclang.newParser("spec/function.c")
+                local cur = get_last_child(parser:getCursor())
+                assert.is_true(rawequal(cur:getType(), cur:getType()))
+                assert.is_true(rawequal(cur:getType():getResultType(), cur:getType():getResultType()))
+                parser:dispose()
+        end)
+
+        it("compares cursors and types with ==", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local cursor = parser:getCursor()
+                local flyweight
+                cursor:visitChildren({reuseCursors = true}, function(cur)
+                        flyweight = cur
+                        return "break"
+                end)
+                local first = cursor:children()()
+                assert.is_false(rawequal(first, flyweight))
+                assert.is_true(first == flyweight)
+                assert.is_false(first == cursor)
+                assert.is_false(first == first:getType())
+                assert.is_true(first:getType() == flyweight:getType())
+                parser:dispose()
+        end)
+
+        it("hashes equal cursors and types to the same integer", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local cursor = parser:getCursor()
+                local hashes = {}
+                for cur in cursor:descendants() do
+                        table.insert(hashes, cur:hash())
+                end
+                local i = 0
+                for cur in cursor:descendants() do
+                        i = i + 1
+                        assert.are.equal(hashes[i], cur:hash())
+                        assert.are.equal(cur:getType():hash(), cur:getType():hash())
+                        assert.are.equal("number", type(cur:hash()))
+                end
+                parser:dispose()
+        end)
+end)
+
+describe("luaclang.parseAll()", function()
+        it("parses every file on worker threads", function()
+                local files = {"spec/visit.c", "spec/function.c", "spec/enum.c", "spec/struct.c", "spec/options.c"}
+                local parsers, errors = luaclang.parseAll(files, {threads = 3})
+                assert.are.same({}, errors)
+                assert.are.equal(#files, #parsers)
+                for i, parser in ipairs(parsers) do
+                        local cur = parser:getCursor()
+                        assert.are.equal(files[i], cur:getSpelling())
+                        parser:dispose()
+                end
+        end)
+
+        it("passes the parse options to every file", function()
+                local parsers = luaclang.parseAll({"spec/options.c", "spec/options.c"},
+                                                  {args = {"-DWITH_EXTRA"}, skipFunctionBodies = true})
+                for _, parser in ipairs(parsers) do
+                        local first = parser:getCursor():children()()
+                        assert.are.equal("extra", first:getSpelling())
+                        parser:dispose()
+                end
+        end)
+
+        it("reports the files which couldn't be parsed", function()
+                local parsers, errors = luaclang.parseAll({"spec/visit.c", "spec/missing.c"})
+                assert.are.equal("file doesn't exist", errors[2])
+                assert.is_false(parsers[2])
+                assert.is_nil(errors[1])
+                parsers[1]:dispose()
+        end)
+
+        it("parses files given as unsaved files", function()
+                local parsers, errors = luaclang.parseAll({"spec/virtual.c"}, {unsaved = {["spec/virtual.c"] = "int virtual_var;"}})
+                assert.are.same({}, errors)
+                local var = parsers[1]:getCursor():children()()
+                assert.are.equal("virtual_var", var:getSpelling())
+                parsers[1]:dispose()
+        end)
+
+        it("throws an error for invalid options", function()
+                assert.has_error(function() luaclang.parseAll({"spec/visit.c"}, {threads = 0}) end,
+                        "bad argument #2 to 'parseAll' (expect a positive number of threads)")
+                assert.has_error(function() luaclang.parseAll({"spec/visit.c"}, {source = "int x;"}) end,
+                        "bad argument #2 to 'parseAll' (source isn't supported by parseAll)")
+                assert.has_error(function() luaclang.parseAll({1}) end,
+                        "bad argument #1 to 'parseAll' (expect an array of file names)")
+        end)
+end)
+
+describe("luaclang.parseAsync()", function()
+        it("parses a file on a background thread", function()
+                local handle = luaclang.parseAsync("spec/visit.c")
+                assert.is_true(handle:wait())
+                assert.is_true(handle:ready())
+                local parser = handle:result()
+                assert.are.equal("spec/visit.c", parser:getCursor():getSpelling())
+                assert.is_true(rawequal(parser, handle:result()))
+                parser:dispose()
+        end)
+
+        it("waits for the parse in result()", function()
+                local handle = luaclang.parseAsync("spec/options.c", {args = {"-DWITH_EXTRA"}})
+                local first = handle:result():getCursor():children()()
+                assert.are.equal("extra", first:getSpelling())
+                handle:result():dispose()
+        end)
+
+        it("waits at most the given time", function()
+                local handle = luaclang.parseAsync("spec/virtual.c", {source = "int x;"})
+                while not handle:wait(0.01) do end
+                assert.is_true(handle:ready())
+                assert.is_true(handle:wait(0))
+                handle:result():dispose()
+        end)
+
+        it("provides a file descriptor", function()
+                local handle = luaclang.parseAsync("spec/visit.c")
+                assert.are.equal("number", type(handle:fd()))
+                handle:result():dispose()
+                assert.has_error(function() handle:fd() end,
+                        "calling 'fd' on bad self (result was already taken)")
+        end)
+
+        it("can be cancelled or dropped", function()
+                local handle = luaclang.parseAsync("spec/visit.c")
+                handle:cancel()
+                assert.has_error(function() handle:result() end,
+                        "calling 'result' on bad self (parse was cancelled)")
+                luaclang.parseAsync("spec/function.c")
+                collectgarbage()
+        end)
+
+        it("throws an error if the file doesn't exist", function()
+                assert.has_error(function() luaclang.parseAsync("spec/missing.c") end, "file doesn't exist")
+        end)
+end)
+
+describe("cursor:getCdef()", function()
+        it("emits the declarations of the translation unit", function()
+                local parser = luaclang.newParser("spec/cdef.c")
+                local expected = [[
+typedef struct {
+    int a;
+} anon_t;
+enum {
+    FLAG_A = 1,
+    FLAG_B = 2,
+};
+struct outer {
+    int x;
+    struct inner {
+        float f;
+    } in;
+    union {
+        int u1;
+        float u2;
+    };
+    unsigned int flags : 3;
+    int arr[4][2];
+    void (*cb)(int, ...);
+};
+typedef int (*binop)(int, int);
+int (*get_op(char))(int, int);
+void nothing(void);
+extern const char *names[];
+]]
+                assert.are.equal(expected, parser:getCursor():getCdef())
+                parser:dispose()
+        end)
+
+        it("emits the declarations passing the filter", function()
+                local parser = luaclang.newParser("spec/extract.c")
+                local cdef = parser:getCursor():getCdef({kinds = {"TypedefDecl", "FunctionDecl"}})
+                assert.are.equal("typedef struct point POINT;\nint distance(struct point, struct point);\n", cdef)
+                assert.are.equal("", luaclang.getNullCursor():getCdef())
+                parser:dispose()
+        end)
+end)
+
+describe("luaclang.extractCached()", function()
+        local cache_dir
+
+        local function extract(header, options)
+                options = options or {}
+                options.cacheDir = cache_dir
+                options.source = '#include "config.h"\nint use(struct config *c);\n'
+                options.unsaved = {["spec/config.h"] = header}
+                return luaclang.extractCached("spec/virtual.c", options)
+        end
+
+        before_each(function()
+                cache_dir = os.tmpname()
+                os.remove(cache_dir)
+                os.execute("mkdir " .. cache_dir)
+        end)
+
+        after_each(function()
+                os.execute("rm -r " .. cache_dir)
+        end)
+
+        it("loads unchanged declarations from the cache", function()
+                local header = "struct config { int level; };\n"
+                local decls, hit = extract(header)
+                assert.is_false(hit)
+                local cached, cached_hit = extract(header)
+                assert.is_true(cached_hit)
+                assert.are.same(decls, cached)
+                local parser = luaclang.newParser("spec/virtual.c", {
+                        source = '#include "config.h"\nint use(struct config *c);\n',
+                        unsaved = {["spec/config.h"] = header}
+                })
+                assert.are.same(parser:getCursor():extract(), cached)
+                parser:dispose()
+        end)
+
+        it("parses again once an included file changed", function()
+                extract("struct config { int level; };\n")
+                local decls, hit = extract("struct config { int level; int mode; };\n")
+                assert.is_false(hit)
+                assert.are.equal(2, #decls[1].fields)
+        end)
+
+        it("keys the entries by the options", function()
+                local header = "struct config { int level; };\n"
+                extract(header)
+                local decls, hit = extract(header, {kinds = {"FunctionDecl"}})
+                assert.is_false(hit)
+                assert.are.equal(1, #decls)
+                local _, args_hit = extract(header, {args = {"-DMODE=1"}})
+                assert.is_false(args_hit)
+        end)
+
+        it("throws an error without cache directory", function()
+                assert.has_error(function() luaclang.extractCached("spec/visit.c", {}) end,
+                        "bad argument #2 to 'extractCached' (expect cacheDir string)")
+        end)
+end)
+
+describe("type layout", function()
+        local function get_layout(parser)
+                for cur in parser:getCursor():children() do
+                        if cur:getSpelling() == "layout" then
+                                return cur
+                        end
+                end
+        end
+
+        it("gets the size and alignment of types", function()
+                local parser = luaclang.newParser("spec/layout.c")
+                local type = get_layout(parser):getType()
+                assert.are.equal(32, type:getSize())
+                assert.are.equal(8, type:getAlign())
+                parser:dispose()
+        end)
+
+        it("gets the offset of fields in bits", function()
+                local parser = luaclang.newParser("spec/layout.c")
+                local cur = get_layout(parser)
+                local type = cur:getType()
+                assert.are.equal(32, type:getOffsetOf("i"))
+                assert.are.equal(67, type:getOffsetOf("more"))
+                assert.are.equal(128, type:getOffsetOf("d"))
+                local offsets = {}
+                for field in cur:children() do
+                        if field:getKind() == "FieldDecl" then
+                                offsets[field:getSpelling()] = field:getFieldOffset()
+                        end
+                end
+                assert.are.same({c = 0, i = 32, flags = 64, more = 67, tail = 192}, offsets)
+                parser:dispose()
+        end)
+
+        it("lists the fields of a record", function()
+                local parser = luaclang.newParser("spec/layout.c")
+                local fields = get_layout(parser):getType():getFields()
+                local names, offsets = {}, {}
+                for i, field in ipairs(fields) do
+                        names[i] = field.name
+                        offsets[i] = field.offset
+                end
+                assert.are.same({"c", "i", "flags", "more", "", "tail"}, names)
+                assert.are.same({0, 32, 64, 67, 128, 192}, offsets)
+                assert.are.equal(3, fields[3].bitWidth)
+                assert.is_nil(fields[1].bitWidth)
+                assert.are.equal("ConstantArray", fields[6].type:getTypeKind())
+                parser:dispose()
+        end)
+
+        it("throws an error for types without layout", function()
+                local parser = luaclang.newParser("spec/layout.c")
+                local incomplete = get_last_child(parser:getCursor()):getType()
+                local type = get_layout(parser):getType()
+                assert.has_error(function() incomplete:getSize() end,
+                        "calling 'getSize' on bad self (type is incomplete)")
+                assert.has_error(function() incomplete:getFields() end,
+                        "calling 'getFields' on bad self (type is incomplete)")
+                assert.has_error(function() type:getOffsetOf("missing") end,
+                        "bad argument #1 to 'getOffsetOf' (no field of that name)")
+                assert.has_error(function() type:getFields()[1].type:getFields() end,
+                        "calling 'getFields' on bad self (expect type object with record kind)")
+                parser:dispose()
+        end)
+end)
+
+describe("parser:internType()", function()
+        it("gives equal canonical types the same id", function()
+                local parser = luaclang.newParser("spec/typedef.c")
+                local ids = {}
+                for cur in parser:getCursor():children() do
+                        table.insert(ids, parser:internType(cur:getType()))
+                end
+                assert.are.equal(ids[1], ids[2])
+                assert.are_not.equal(ids[1], ids[3])
+                assert.are.equal(ids[1], parser:getTypeInfo(ids[3]).pointee)
+                assert.are.equal(ids[3], parser:internType(get_last_child(parser:getCursor()):getType()))
+                parser:dispose()
+        end)
+
+        it("describes the interned types", function()
+                local parser = luaclang.newParser("spec/cdef.c")
+                local binop
+                for cur in parser:getCursor():children() do
+                        if cur:getSpelling() == "binop" then
+                                binop = cur
+                        end
+                end
+                local id = parser:internType(binop:getType())
+                local info = parser:getTypeInfo(id)
+                assert.are.equal(id, info.id)
+                assert.are.equal("Pointer", info.kind)
+                local func = parser:getTypeInfo(info.pointee)
+                assert.are.equal("FunctionProto", func.kind)
+                assert.is_false(func.isVariadic)
+                assert.are.equal(2, #func.args)
+                assert.are.equal(func.result, func.args[1])
+                assert.are.equal(func.args[1], func.args[2])
+                assert.are.equal("int", parser:getTypeInfo(func.result).spelling)
+                assert.is_true(rawequal(info, parser:getTypeInfo(id)))
+                assert.is_true(rawequal(info, parser:getTypes()[id]))
+                assert.are.equal(3, #parser:getTypes())
+                parser:dispose()
+        end)
+
+        it("describes arrays and qualifiers", function()
+                local parser = luaclang.newParser("spec/cdef.c")
+                local names = get_last_child(parser:getCursor())
+                local info = parser:getTypeInfo(parser:internType(names:getType()))
+                assert.are.equal("IncompleteArray", info.kind)
+                local pointer = parser:getTypeInfo(info.element)
+                local char = parser:getTypeInfo(pointer.pointee)
+                assert.is_false(pointer.isConst)
+                assert.is_true(char.isConst)
+                assert.are.equal("const char", char.spelling)
+                parser:dispose()
+        end)
+
+        it("throws an error for types of another parser and unknown ids", function()
+                local parser = luaclang.newParser("spec/cdef.c")
+                local other = luaclang.newParser("spec/visit.c")
+                local type = get_last_child(other:getCursor()):getType()
+                assert.has_error(function() parser:internType(type) end,
+                        "bad argument #1 to 'internType' (type belongs to another translation unit)")
+                assert.has_error(function() parser:getTypeInfo(1) end,
+                        "bad argument #1 to 'getTypeInfo' (unknown type id)")
+                parser:dispose()
+                other:dispose()
+        end)
+end)
+
+describe("parser statistics", function()
+        it("reports the memory used by the translation unit", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local stats = parser:stats()
+                assert.is_number(stats.parseTime)
+                assert.is_true(stats.parseTime >= 0)
+                assert.are.equal(0, stats.numReparses)
+                assert.is_table(stats.memory)
+                local total = 0
+                for name, amount in pairs(stats.memory) do
+                        assert.is_string(name)
+                        total = total + amount
+                end
+                assert.are.equal(total, stats.memoryTotal)
+                assert.is_true(stats.memoryTotal > 0)
+                parser:dispose()
+        end)
+
+        it("counts visited cursors, callbacks and allocated objects", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                local cur = parser:getCursor()
+                local before = parser:stats()
+                local calls = 0
+                cur:visitChildren(function() calls = calls + 1 return "recurse" end)
+                local after = parser:stats()
+                assert.is_true(calls > 0)
+                assert.are.equal(before.callbacks + calls, after.callbacks)
+                assert.are.equal(before.cursorsVisited + calls, after.cursorsVisited)
+                assert.is_true(after.objectsAllocated > before.objectsAllocated)
+                local seen = 0
+                for _ in cur:descendants() do seen = seen + 1 end
+                assert.are.equal(after.cursorsVisited + seen, parser:stats().cursorsVisited)
+                assert.are.equal(after.callbacks, parser:stats().callbacks)
+                parser:dispose()
+        end)
+
+        it("counts reparses", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                parser:reparse()
+                parser:reparse()
+                assert.are.equal(2, parser:stats().numReparses)
+                parser:dispose()
+        end)
+
+        it("throws an error for a disposed parser", function()
+                local parser = luaclang.newParser("spec/visit.c")
+                parser:dispose()
+                assert.has_error(function() parser:stats() end,
+                        "calling 'stats' on bad self (parser object was disposed)")
+        end)
+end)
+
+describe("parser:getDiagnostics([options])", function()
+        it("describes every diagnostic", function()
+                local parser = luaclang.newParser("spec/notes.c")
+                local diags = parser:getDiagnostics()
+                assert.are.equal(2, #diags)
+                local conflict, warning = diags[1], diags[2]
+                assert.are.equal("error", conflict.severity)
+                assert.are.equal("spec/notes.c", conflict.file)
+                assert.are.equal(2, conflict.line)
+                assert.are.equal(5, conflict.column)
+                assert.are.equal("Semantic Issue", conflict.category)
+                assert.are.equal(1, #conflict.notes)
+                assert.are.equal("note", conflict.notes[1].severity)
+                assert.are.equal(1, conflict.notes[1].line)
+                assert.are.equal("warning", warning.severity)
+                assert.are.equal("-Wparentheses", warning.option)
+                assert.are.same({{file = "spec/notes.c", startLine = 6, startColumn = 13, endLine = 6, endColumn = 18}},
+                        warning.ranges)
+                assert.are.equal(2, #warning.notes)
+                local fixits = warning.notes[1].fixits
+                assert.are.equal(2, #fixits)
+                assert.are.equal("(", fixits[1].text)
+                assert.are.equal(13, fixits[1].startColumn)
+                assert.are.equal(")", fixits[2].text)
+                assert.are.equal("==", warning.notes[2].fixits[1].text)
+                parser:dispose()
+        end)
+
+        it("formats the messages once they are read", function()
+                local parser = luaclang.newParser("spec/notes.c")
+                local diags = parser:getDiagnostics()
+                assert.is_nil(rawget(diags[1], "message"))
+                assert.are.equal("conflicting types for 'add'", diags[1].message)
+                assert.are.equal("conflicting types for 'add'", rawget(diags[1], "message"))
+                assert.are.equal("spec/notes.c:2:5: error: conflicting types for 'add'", diags[1].text)
+                assert.are.equal("previous declaration is here", diags[1].notes[1].message)
+                assert.are.equal("==", diags[2].notes[2].fixits[1].text)
+                assert.is_nil(diags[1].unknown)
+                parser:dispose()
+        end)
+
+        it("filters by severity and limits the number of diagnostics", function()
+                local parser = luaclang.newParser("spec/notes.c")
+                local errors = parser:getDiagnostics{minSeverity = "error"}
+                assert.are.equal(1, #errors)
+                assert.are.equal("error", errors[1].severity)
+                assert.are.equal(2, #parser:getDiagnostics{minSeverity = "warning"})
+                local first = parser:getDiagnostics{limit = 1}
+                assert.are.equal(1, #first)
+                assert.are.equal(2, first[1].line)
+                assert.are.equal(0, #parser:getDiagnostics{limit = 0})
+                parser:dispose()
+        end)
+
+        it("throws an error for invalid options and outdated diagnostics", function()
+                local parser = luaclang.newParser("spec/notes.c")
+                assert.has_error(function() parser:getDiagnostics{minSeverity = "severe"} end,
+                        "bad argument #1 to 'getDiagnostics' (unknown minSeverity)")
+                assert.has_error(function() parser:getDiagnostics{limit = -1} end,
+                        "bad argument #1 to 'getDiagnostics' (expect non-negative integer limit)")
+                local diags = parser:getDiagnostics()
+                parser:reparse()
+                assert.has_error(function() return diags[1].message end, "parser object was reparsed")
+                diags = parser:getDiagnostics()
+                parser:dispose()
+                assert.has_error(function() return diags[1].text end, "parser object was disposed")
+        end)
+end)
+
+describe("parser:getMacros([options])", function()
+        it("evaluates the object-like macros", function()
+                local parser = luaclang.newParser("spec/macros.c", {detailedPreprocessingRecord = true})
+                local macros = parser:getMacros()
+                assert.are.same({
+                        HEADER_LIMIT = 16,
+                        ANSWER = 42,
+                        HEX = 31,
+                        NEGATIVE = -8,
+                        RATIO = 0.5,
+                        MASK = 17,
+                        DOUBLE_LIMIT = 32,
+                        AFTER = 10,
+                        BEFORE = 9,
+                        PICK = string.byte("y"),
+                        CAST = 2,
+                        NAME = "luaclang\n",
+                        ALIAS = "luaclang\n"
+                }, macros)
+                assert.are.equal("integer", math.type(macros.ANSWER))
+                assert.are.equal("float", math.type(macros.RATIO))
+                parser:dispose()
+        end)
+
+        it("evaluates the integers with their C types", function()
+                local parser = luaclang.newParser("spec/macro_types.c", {detailedPreprocessingRecord = true})
+                local macros = parser:getMacros()
+                assert.are.same({
+                        ALL_ONES = 4294967295,
+                        BYTE = 255,
+                        SIGNED_BYTE = -56,
+                        COMPARE_UNSIGNED = 0,
+                        COMPARE_LONG = 1,
+                        SHIFT_UNSIGNED = 1,
+                        WRAP = 1,
+                        UNTAKEN_BRANCH = 2,
+                        UNTAKEN_AND = 0,
+                        UNTAKEN_OR = 1,
+                        INT_BITS = 32,
+                        INT_LIMIT = 2147483647
+                }, macros)
+                parser:dispose()
+        end)
+
+        it("only collects the macros of the selected files", function()
+                local parser = luaclang.newParser("spec/macros.c", {detailedPreprocessingRecord = true})
+                assert.are.same({HEADER_LIMIT = 16}, parser:getMacros{files = {"spec/macros.h"}})
+                local macros = parser:getMacros{mainFileOnly = true}
+                assert.is_nil(macros.HEADER_LIMIT)
+                assert.are.equal(32, macros.DOUBLE_LIMIT)
+                assert.are.equal(42, macros.ANSWER)
+                parser:dispose()
+        end)
+
+        it("needs the detailed preprocessing record", function()
+                local parser = luaclang.newParser("spec/macros.c")
+                assert.are.same({}, parser:getMacros())
+                parser:dispose()
+        end)
+
+        it("exposes the macro definitions as cursors", function()
+                local parser = luaclang.newParser("spec/macros.c", {detailedPreprocessingRecord = true})
+                local kinds = {}
+                for cur in parser:getCursor():children() do
+                        kinds[cur:getKind()] = true
+                end
+                assert.is_true(kinds.MacroDefinition)
+                assert.is_true(kinds.InclusionDirective)
+                parser:dispose()
+        end)
+end)
+
+describe("parser:buildIndex()", function()
+        it("indexes the distinct declarations", function()
+                local parser = luaclang.newParser("spec/index.c")
+                assert.are.equal(11, parser:buildIndex())
+                parser:dispose()
+        end)
+
+        it("finds declarations by name and kind", function()
+                local parser = luaclang.newParser("spec/index.c")
+                parser:buildIndex()
+                local node = parser:findDecl("node", "StructDecl")
+                assert.are.equal("StructDecl", node:getKind())
+                assert.are.equal(node, node:getCursorDefinition())
+                assert.are.equal(node, parser:findDecl("node"))
+                assert.are.equal("TypedefDecl", parser:findDecl("node", "TypedefDecl"):getKind())
+                assert.are.equal("FieldDecl", parser:findDecl("size"):getKind())
+                assert.are.equal("StructDecl", parser:findDecl("payload", "StructDecl"):getKind())
+                assert.are.equal("FieldDecl", parser:findDecl("payload", "FieldDecl"):getKind())
+                assert.are.equal("EnumConstantDecl", parser:findDecl("GREEN"):getKind())
+                assert.is_nil(parser:findDecl("local"))
+                assert.is_nil(parser:findDecl("list"))
+                assert.is_nil(parser:findDecl("color", "StructDecl"))
+                parser:dispose()
+        end)
+
+        it("finds declarations by USR", function()
+                local parser = luaclang.newParser("spec/index.c")
+                local node = parser:findDecl("node", "StructDecl")
+                assert.are.equal("c:@S@node", node:getUSR())
+                assert.are.equal(node, parser:findByUSR("c:@S@node"))
+                assert.are.equal("count", parser:findByUSR("c:@F@count"):getSpelling())
+                assert.is_nil(parser:findByUSR("c:@S@missing"))
+                assert.is_nil(parser:findByUSR(""))
+                parser:dispose()
+        end)
+
+        it("doesn't traverse the AST on lookups", function()
+                local parser = luaclang.newParser("spec/index.c")
+                parser:buildIndex()
+                local visited = parser:stats().cursorsVisited
+                for _ = 1, 100 do
+                        parser:findDecl("count")
+                        parser:findByUSR("c:@E@color")
+                end
+                assert.are.equal(visited, parser:stats().cursorsVisited)
+                parser:reparse()
+                assert.are.equal("FunctionDecl", parser:findDecl("count"):getKind())
+                parser:dispose()
+        end)
+end)
+
+describe("luaclang.newDeclDB()", function()
+        it("merges the declarations of several parsers by USR", function()
+                local db = luaclang.newDeclDB()
+                local parser = luaclang.newParser("spec/shared_b.c")
+                assert.are.equal(4, db:ingest(parser))
+                parser:dispose()
+                parser = luaclang.newParser("spec/shared_a.c")
+                assert.are.equal(3, db:ingest(parser))
+                parser:dispose()
+                local records, ingested = db:count()
+                assert.are.equal(7, records)
+                assert.are.equal(11, ingested)
+                local names = {}
+                for record in db:records() do
+                        table.insert(names, record.name)
+                end
+                assert.are.same({"length_t", "buffer", "buffer_size", "total", "data", "len", "helper"}, names)
+                db:dispose()
+        end)
+
+        it("keeps the definition of a declaration", function()
+                local db = luaclang.newDeclDB()
+                for _, file in ipairs({"spec/shared_b.c", "spec/shared_a.c"}) do
+                        local parser = luaclang.newParser(file)
+                        db:ingest(parser)
+                        parser:dispose()
+                end
+                assert.are.same({
+                        kind = "StructDecl",
+                        name = "buffer",
+                        usr = "c:@S@buffer",
+                        type = "struct buffer",
+                        file = "spec/shared_a.c",
+                        line = 3,
+                        column = 8,
+                        isDefinition = true
+                }, db:findDecl("buffer", "StructDecl"))
+                assert.are.equal("length_t (struct buffer **, int)", db:findByUSR("c:@F@total").type)
+                assert.are.equal("FieldDecl", db:findDecl("len").kind)
+                assert.is_nil(db:findDecl("buffer", "TypedefDecl"))
+                assert.is_nil(db:findByUSR("c:@F@missing"))
+                db:dispose()
+        end)
+
+        it("throws an error for disposed objects", function()
+                local db = luaclang.newDeclDB()
+                local parser = luaclang.newParser("spec/shared_a.c")
+                parser:dispose()
+                assert.has_error(function() db:ingest(parser) end,
+                        "bad argument #1 to 'ingest' (parser object was disposed)")
+                db:dispose()
+                assert.has_error(function() db:count() end,
+                        "calling 'count' on bad self (database object was disposed)")
+        end)
+end)
+
+describe("index:indexFiles(files [, options] [, batch_function])", function()
+        it("reports the declarations of every file", function()
+                local index = luaclang.newIndex()
+                local records, errors = index:indexFiles({"spec/shared_a.c", "spec/shared_b.c"})
+                assert.are.same({}, errors)
+                assert.are.equal(11, #records)
+                assert.are.same({
+                        kind = "StructDecl",
+                        name = "buffer",
+                        usr = "c:@S@buffer",
+                        file = "spec/shared_a.c",
+                        line = 3,
+                        column = 8,
+                        isDefinition = true,
+                        isRedeclaration = true
+                }, records[4])
+                assert.are.equal("total", records[11].name)
+                index:dispose()
+        end)
+
+        it("filters by kind and passes the records in batches", function()
+                local index = luaclang.newIndex()
+                local batches, names = {}, {}
+                local total = index:indexFiles({"spec/shared_a.c", "spec/shared_b.c"},
+                        {kinds = {"FunctionDecl"}, batchSize = 3, skipParsedBodies = true},
+                        function(batch)
+                                table.insert(batches, #batch)
+                                for _, record in ipairs(batch) do
+                                        table.insert(names, record.name)
+                                end
+                        end)
+                assert.are.equal(4, total)
+                assert.are.same({3, 1}, batches)
+                assert.are.same({"buffer_size", "helper", "buffer_size", "total"}, names)
+                index:dispose()
+        end)
+
+        it("reports the files which couldn't be indexed", function()
+                local index = luaclang.newIndex()
+                local records, errors = index:indexFiles({"spec/missing.c", "spec/shared_b.c"}, function() end)
+                assert.are.equal(4, records)
+                assert.are.same({[1] = "file doesn't exist"}, errors)
+                index:dispose()
+        end)
+
+        it("propagates the errors of the batch function", function()
+                local index = luaclang.newIndex()
+                assert.has_error(function()
+                        index:indexFiles({"spec/shared_a.c"}, {batchSize = 1}, function() error("stop", 0) end)
+                end, "stop")
+                index:dispose()
+        end)
+end)
+
+describe("kind ids", function()
+        it("names every cursor kind reached by a traversal", function()
+                local parser = luaclang.newParser("spec/index.c")
+                local kinds = {}
+                parser:getCursor():visitChildren(function (cursor)
+                        local id = cursor:getKindId()
+                        assert.are.equal(luaclang.cursorKinds[cursor:getKind()], id)
+                        assert.are.equal(cursor:getKind(), luaclang.cursorKinds[id])
+                        kinds[cursor:getKind()] = true
+                        return "recurse"
+                end)
+                assert.is_true(kinds.CompoundStmt)
+                assert.is_true(kinds.ReturnStmt)
+                assert.is_true(kinds.DeclRefExpr)
+                assert.is_nil(kinds.Unaddressed)
+                parser:dispose()
+        end)
+
+        it("exports the cursor and type kind constants", function()
+                assert.are.equal(2, luaclang.cursorKinds.StructDecl)
+                assert.are.equal(106, luaclang.cursorKinds.IntegerLiteral)
+                assert.are.equal(350, luaclang.cursorKinds.TranslationUnit)
+                assert.are.equal("CXXBaseSpecifier", luaclang.cursorKinds[44])
+                assert.are.equal("MacroDefinition", luaclang.cursorKinds[501])
+                assert.are.equal(17, luaclang.typeKinds.Int)
+                assert.are.equal("Pointer", luaclang.typeKinds[101])
+        end)
+
+        it("returns the type kind id", function()
+                local parser = luaclang.newParser("spec/function.c")
+                local func = get_last_child(parser:getCursor())
+                local arg = func:getArgCursor(2)
+                assert.are.equal(luaclang.typeKinds.Pointer, arg:getType():getKindId())
+                assert.are.equal("Pointer", luaclang.typeKinds[arg:getType():getKindId()])
+                assert.are.equal(luaclang.typeKinds.FunctionProto, func:getType():getKindId())
+                parser:dispose()
+        end)
+
+        it("accepts kind ids wherever kind names are accepted", function()
+                local parser = luaclang.newParser("spec/index.c")
+                parser:buildIndex()
+                local node = parser:findDecl("node", luaclang.cursorKinds.StructDecl)
+                assert.are.equal("StructDecl", node:getKind())
+                assert.is_nil(parser:findDecl("node", luaclang.cursorKinds.FunctionDecl))
+                assert.is_nil(parser:findDecl("node", "NoSuchDecl"))
+                parser:dispose()
+                parser = luaclang.newParser("spec/extract.c")
+                local decls = parser:getCursor():extract{kinds = {luaclang.cursorKinds.FunctionDecl, "VarDecl"}}
+                assert.are.same({"distance", "counter"}, {decls[1].spelling, decls[2].spelling})
+                parser:dispose()
+        end)
+end)
+
+describe("luaclang.usePCH()", function()
+        local pch_file
+
+        -- what the binding reports about 'file_name', parsed with the options 'options'
+        local function summary(file_name, options)
+                options.detailedPreprocessingRecord = true
+                local parser = luaclang.newParser(file_name, options)
+                local spellings = {}
+                parser:getCursor():visitChildren(function(cursor, parent)
+                        -- the generated header of the PCH adds its own #include directives
+                        if cursor:getKind() ~= "InclusionDirective" then
+                                table.insert(spellings, cursor:getSpelling())
+                        end
+                        return "recurse"
+                end)
+                local decls = parser:getCursor():extract()
+                for _, decl in ipairs(decls) do
+                        -- the PCH stores the absolute file names of its headers
+                        decl.file = decl.file:match("spec/.*$")
+                end
+                local result = {
+                        usedPCH = parser:stats().usedPCH,
+                        spellings = spellings,
+                        decls = decls,
+                        macros = parser:getMacros(),
+                        found = parser:findDecl("pch_int") ~= nil
+                }
+                parser:dispose()
+                return result
+        end
+
+        before_each(function()
+                pch_file = os.tmpname()
+        end)
+
+        after_each(function()
+                luaclang.usePCH(nil)
+                os.remove(pch_file)
+        end)
+
+        it("is used by the parsers with the same compiler arguments", function()
+                assert.are.same({"spec/pch.h"}, luaclang.usePCH(pch_file, {"pch.h"}, {args = {"-Ispec"}}))
+                local parser = luaclang.newParser("spec/pch.c", {args = {"-Ispec"}})
+                assert.are.same({}, parser:getDiagnostics())
+                assert.is_true(parser:stats().usedPCH)
+                parser:dispose()
+                local parsers = luaclang.parseAll({"spec/pch.c"}, {args = {"-Ispec"}})
+                assert.are.same({}, parsers[1]:getDiagnostics())
+                assert.is_true(parsers[1]:stats().usedPCH)
+                parsers[1]:dispose()
+                local index = luaclang.newIndex{excludeDeclarationsFromPCH = false}
+                parser = index:newParser("spec/pch.c", {args = {"-Ispec"}})
+                assert.is_true(parser:stats().usedPCH)
+                parser:dispose()
+                index:dispose()
+        end)
+
+        it("isn't used with other compiler arguments, usePCH = false or an index excluding it", function()
+                luaclang.usePCH(pch_file, {"pch.h"}, {args = {"-Ispec"}})
+                local parser = luaclang.newParser("spec/pch.c", {args = {"-Ispec", "-DOTHER"}})
+                assert.is_false(parser:stats().usedPCH)
+                parser:dispose()
+                parser = luaclang.newParser("spec/pch.c", {args = {"-Ispec"}, usePCH = false})
+                assert.is_false(parser:stats().usedPCH)
+                parser:dispose()
+                local index = luaclang.newIndex()
+                parser = index:newParser("spec/pch.c", {args = {"-Ispec"}})
+                assert.is_false(parser:stats().usedPCH)
+                assert.is_not_nil(parser:findDecl("pch_int"))
+                parser:dispose()
+                index:dispose()
+                luaclang.usePCH(nil)
+                parser = luaclang.newParser("spec/pch.c", {args = {"-Ispec"}})
+                assert.is_false(parser:stats().usedPCH)
+                parser:dispose()
+        end)
+
+        it("doesn't change what the parsers see", function()
+                luaclang.usePCH(pch_file, {"pch.h"}, {args = {"-Ispec"}})
+                local with_pch = summary("spec/pch.c", {args = {"-Ispec"}})
+                local without_pch = summary("spec/pch.c", {args = {"-Ispec"}, usePCH = false})
+                assert.is_true(with_pch.usedPCH)
+                assert.is_false(without_pch.usedPCH)
+                with_pch.usedPCH, without_pch.usedPCH = nil, nil
+                assert.are.same(without_pch, with_pch)
+                assert.are.same({PCH_MARK = 7, NEXT = 8}, with_pch.macros)
+                assert.is_true(with_pch.found)
+        end)
+
+        it("is only used by the files which start by including its headers", function()
+                luaclang.usePCH(pch_file, {"pch.h"}, {args = {"-Ispec"}})
+                local parser = luaclang.newParser("user.c", {args = {"-Ispec"}, source = "pch_int value;"})
+                assert.are.equal("unknown type name 'pch_int'", parser:getDiagnostics()[1].message)
+                assert.is_false(parser:stats().usedPCH)
+                parser:dispose()
+                local source = "#define _GNU_SOURCE\n#include \"pch.h\"\npch_int value;"
+                parser = luaclang.newParser("user.c", {args = {"-Ispec"}, source = source})
+                assert.are.same({}, parser:getDiagnostics())
+                assert.is_false(parser:stats().usedPCH)
+                parser:dispose()
+                source = "/* comment */\n#include <pch.h> // common\npch_int value;"
+                parser = luaclang.newParser("user.c", {args = {"-Ispec"}, source = source})
+                assert.are.same({}, parser:getDiagnostics())
+                assert.is_true(parser:stats().usedPCH)
+                parser:dispose()
+                local parsers = luaclang.parseAll({"spec/pch.c", "user.c"},
+                                                  {args = {"-Ispec"}, unsaved = {["user.c"] = "pch_int value;"}})
+                assert.is_true(parsers[1]:stats().usedPCH)
+                assert.is_false(parsers[2]:stats().usedPCH)
+                assert.are.equal("unknown type name 'pch_int'", parsers[2]:getDiagnostics()[1].message)
+                parsers[1]:dispose()
+                parsers[2]:dispose()
+        end)
+
+        it("is rebuilt once a header changed", function()
+                local header = os.tmpname()
+                local file = io.open(header, "w")
+                file:write("#pragma once\ntypedef int pch_int;\n")
+                file:close()
+                luaclang.usePCH(pch_file, {header})
+                local source = "#include \"" .. header .. "\"\npch_int value;"
+                local parser = luaclang.newParser("user.c", {source = source})
+                local value = get_last_child(parser:getCursor())
+                assert.are.equal(4, value:getType():getSize())
+                assert.is_true(parser:stats().usedPCH)
+                parser:dispose()
+                file = io.open(header, "w")
+                file:write("#pragma once\ntypedef long long pch_int;\n")
+                file:close()
+                parser = luaclang.newParser("user.c", {source = source})
+                value = get_last_child(parser:getCursor())
+                assert.are.equal(8, value:getType():getSize())
+                assert.is_true(parser:stats().usedPCH)
+                parser:dispose()
+                os.remove(header)
+        end)
+
+        it("raises the error of a failed rebuild until the header is fixed", function()
+                local header = os.tmpname()
+                local file = io.open(header, "w")
+                file:write("#pragma once\ntypedef int pch_int;\n")
+                file:close()
+                luaclang.usePCH(pch_file, {header})
+                local source = "#include \"" .. header .. "\"\npch_int value;"
+                file = io.open(header, "w")
+                file:write("#pragma once\ntypedef missing_type pch_int;\n")
+                file:close()
+                assert.has_error(function()
+                        luaclang.newParser("user.c", {source = source})
+                end, "precompiled header has errors")
+                local parser = luaclang.newParser("user.c", {source = source, usePCH = false})
+                assert.is_false(parser:stats().usedPCH)
+                parser:dispose()
+                file = io.open(header, "w")
+                file:write("#pragma once\ntypedef short pch_int;\n")
+                file:close()
+                parser = luaclang.newParser("user.c", {source = source})
+                assert.is_true(parser:stats().usedPCH)
+                assert.are.equal(2, get_last_child(parser:getCursor()):getType():getSize())
+                parser:dispose()
+                os.remove(header)
+        end)
+
+        it("raises an error when a header has errors", function()
+                assert.has_error(function()
+                        luaclang.usePCH(pch_file, {"missing.h"})
+                end, "precompiled header has errors")
+        end)
+end)
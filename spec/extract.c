@@ -0,0 +1,12 @@
+struct point {
+        int x;
+        int y: 4;
+};
+
+enum color {red, green = 5};
+
+typedef struct point POINT;
+
+extern int distance(struct point a, struct point b);
+
+static int counter;
\ No newline at end of file
@@ -0,0 +1,18 @@
+struct node;
+typedef struct node node;
+
+struct node {
+        int value;
+        struct node *next;
+        struct payload {
+                int size;
+        } payload;
+};
+
+enum color {RED, GREEN};
+
+int count(node *list)
+{
+        int local = 0;
+        return local;
+}
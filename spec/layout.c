@@ -0,0 +1,13 @@
+struct layout {
+        char c;
+        int i;
+        unsigned flags : 3;
+        unsigned more : 5;
+        union {
+                short s;
+                double d;
+        };
+        char tail[3];
+};
+
+struct incomplete;
@@ -0,0 +1,15 @@
+#define ALL_ONES (~0U)
+#define BYTE ((unsigned char) -1)
+#define SIGNED_BYTE ((signed char) 200)
+#define COMPARE_UNSIGNED (-1 < 0U)
+#define COMPARE_LONG (-1 < 0L)
+#define SHIFT_UNSIGNED (0x80000000 >> 31)
+#define WIDE_UNSIGNED (~0ULL)
+#define WRAP (0U - 1 == ALL_ONES)
+#define UNTAKEN_BRANCH (1 ? 2 : 1 / 0)
+#define UNTAKEN_AND (0 && 1 / 0)
+#define UNTAKEN_OR (1 || 1 / 0)
+#define TAKEN_BRANCH (0 ? 2 : 1 / 0)
+#define OVERFLOW_SHIFT (1 << 32)
+#define INT_BITS (__SIZEOF_INT__ * 8)
+#define INT_LIMIT __INT_MAX__
@@ -0,0 +1,18 @@
+#include "macros.h"
+
+#define MACROS_C
+#define ANSWER 42
+#define HEX 0x1fUL
+#define NEGATIVE (-8)
+#define RATIO 0.5f
+#define MASK (1 << 4 | 1)
+#define DOUBLE_LIMIT (HEADER_LIMIT * 2)
+#define AFTER (BEFORE + 1)
+#define BEFORE 9
+#define PICK (ANSWER > 40 ? 'y' : 'n')
+#define CAST ((int) 2.75)
+#define NAME "lua" "clang\n"
+#define ALIAS NAME
+#define SQUARE(x) ((x) * (x))
+#define ATTRIBUTE __attribute__((unused))
+#define DIVIDE_BY_ZERO (1 / 0)
@@ -0,0 +1 @@
+#define HEADER_LIMIT 16
@@ -0,0 +1,9 @@
+int add(int a, int b);
+int add(int a, int b, int c);
+
+int assign(int x)
+{
+        if (x = 1)
+                return 0;
+        return 1;
+}
@@ -0,0 +1,10 @@
+#ifdef WITH_EXTRA
+struct extra {
+        int a;
+};
+#endif
+
+int add(int a, int b)
+{
+        return a + b;
+}
\ No newline at end of file
@@ -0,0 +1,4 @@
+#include "pch.h"
+
+#define NEXT (PCH_MARK + 1)
+pch_int value = PCH_MARK;
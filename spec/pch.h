@@ -0,0 +1,7 @@
+#ifndef PCH_H
+#define PCH_H
+
+typedef int pch_int;
+#define PCH_MARK 7
+
+#endif
@@ -0,0 +1,5 @@
+typedef unsigned long length_t;
+
+struct buffer;
+
+int buffer_size(struct buffer *buf);
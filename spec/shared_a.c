@@ -0,0 +1,8 @@
+#include "shared.h"
+
+struct buffer {
+        char *data;
+        length_t len;
+};
+
+static int helper(void);
@@ -0,0 +1,3 @@
+#include "shared.h"
+
+length_t total(struct buffer **bufs, int count);